@@ -21,6 +21,9 @@
 //Use test tone as input (set to 1)?  Or, use live audio (set to zero)
 #define USE_TEST_TONE_INPUT 0
 
+//Process in fixed point, directly on the Int16 audio (set to 1)?  Or, in float (set to zero)
+#define USE_FIXED_POINT 0
+
 //include my custom AudioStream.h...this prevents the default one from being used
 #include "AudioStream_Mod.h"
 
@@ -47,6 +50,17 @@ AudioOutputI2S          i2s_out;        //Digital audio *to* the Teensy Audio Bo
 
 
 //Make all of the audio connections
+#if (USE_FIXED_POINT == 1)
+  AudioEffectMineQ15      effect1;        //This is your own algorithms, in fixed point on the Int16 audio
+
+  #if (USE_TEST_TONE_INPUT == 1)
+    AudioConnection       patchCord1(testSignal, 0, effect1, 0);    //use test tone as audio input
+  #else
+    AudioConnection       patchCord1(i2s_in, 0, effect1, 0);    //use real audio input (microphones or line-in)
+  #endif
+  AudioConnection         patchCord20(effect1, 0, i2s_out, 0);  //connect the Left processor to the Left output
+  AudioConnection         patchCord21(effect1, 0, i2s_out, 1);  //connect the Left processor to the Right output
+#else
 AudioConvert_I16toF32   int2Float1;     //Converts Int16 to Float.  See class in AudioStream_F32.h
 AudioEffectMine_F32     effect1;        //This is your own algorithms
 AudioConvert_F32toI16   float2Int1;     //Converts Float to Int16.  See class in AudioStream_F32.h
@@ -62,6 +76,7 @@ AudioConnection_F32     patchCord10(int2Float1, 0, effect1, 0);    //Left.  make
 AudioConnection_F32     patchCord12(effect1, 0, float2Int1, 0);    //Left.  makes Float connections between objects
 AudioConnection         patchCord20(float2Int1, 0, i2s_out, 0);  //connect the Left float processor to the Left output
 AudioConnection         patchCord21(float2Int1, 0, i2s_out, 1);  //connect the Right float processor to the Right output
+#endif
 
 
 //I have a potentiometer on the Teensy Audio Board
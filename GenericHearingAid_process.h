@@ -1,11 +1,15 @@
 extern "C" {
 #include "chapro.h"
 #include "cha_ff.h"
+#include "cha_fix.h"
 #include "cha_ff_data128.h"
 }
 
 #define CHUNK_SIZE 128
-#define NUM_FREQ_CHAN 8
+#define GAIN_INTERVAL 8   //compute the channel compressor gains every 8 samples and interpolate in between (the limiters run per sample)
+#define NUM_PROGRAMS 2    //resident presets: 0 = the prescription as fitted, 1 = music (no compression)
+#define FADE_SAMPLES 512  //length of the crossfade when the program is changed (about 21 ms at 24 kHz)
+#define LIMIT_MSEC 1.5    //look-ahead of the output limiter (ms), which adds this much latency
 
 /*
    GenericHearingAid_process
@@ -29,6 +33,36 @@ class AudioEffectMine_F32 : public AudioStream_F32
     //constructor
     AudioEffectMine_F32(void) : AudioStream_F32(1, inputQueueArray_f32) {
       //do any setup activities here
+      CHA_PTR cp;
+      CHA_PTR programs[NUM_PROGRAMS];
+      active = 0;  //pass the audio through unless the setup below succeeds
+      programs[0] = (CHA_PTR) cha_data;
+      if (cha_data_init(programs[0])) return;  //the filter responses stay in flash until the first parameter change, the state goes to RAM
+      int np = 1;
+      programs[1] = cha_copy(programs[0]);  //music program: the same gains, but linear
+      if (programs[1] != NULL) {
+        cp = programs[1];
+        for (int k = 0; k < CHA_IVAR[_nc]; k++) ((float *) cp[_gccr])[k] = 1.0f;
+        np = NUM_PROGRAMS;
+      }
+
+      //set up the FFT plan once (shared by all programs) and the compressors of each program;
+      //if the music program cannot be set up, the fitted program runs alone
+      if (setupPrograms(programs, np)) {
+        if (np == 1) return;
+        cha_cleanup(programs[1]);
+        free(programs[1]);
+        np = 1;
+        if (setupPrograms(programs, np)) return;
+      }
+      //move the arrays of each copied program into one aligned block, per-block state first
+      static int hot[] = {CHA_FF_STATE};
+      for (int i = 1; i < np; i++) {
+        if (cha_arena_pack(programs[i], hot, sizeof(hot) / sizeof(int), programs[0])) {
+          break;  //no memory for the block: the program keeps its separate arrays, which work as well
+        }
+      }
+      active = 1;
     };
 
     //here's the method that is called automatically by the Teensy Audio Library
@@ -38,8 +72,11 @@ class AudioEffectMine_F32 : public AudioStream_F32
       audio_block = AudioStream_F32::receiveWritable_f32();
       if (!audio_block) return;
 
-      //users could choose to put all of their processing in this method
+      //users could choose to put all of their processing in this method.
+      //The guard flushes subnormal floats to zero while the CHA code runs.
+      unsigned int fpu = cha_fpu_guard();
       applyMyAlgorithm(audio_block);
+      cha_fpu_restore(fpu);
       
 
       ///transmit the block and release memory
@@ -52,27 +89,16 @@ class AudioEffectMine_F32 : public AudioStream_F32
     // Here is where you can add your algorithm.
     // This function gets called block-wise...which is usually hard-coded to every 128 samples
     void applyMyAlgorithm(audio_block_f32_t *audio_block) {
-      //get and set CHA-specific parameters
-      CHA_PTR cp;
-      cp = (CHA_PTR) cha_data; 
       int n = CHUNK_SIZE;  // chunck size
-      int nc = NUM_FREQ_CHAN;   // number of channels
 
-      //allocate some memory for CHA processing
-      //float *x; // hold filterbank data
-      //x = (float *) calloc(n * nc * 2, sizeof(float)); // better, initializes memory
-      //x = (float *) malloc(n * nc * 2 * sizeof(float)); // faster, does not initialize memory
-      memset(x,0.0f,n*nc*2);  //clear this working memory
+      if (!active) return;  //setup failed: pass the audio through
 
-      //do CHA processing
-      cha_agc_input(cp, audio_block->data, audio_block->data, n);
-      cha_firfb_analyze(cp, audio_block->data, x, n);
-      cha_agc_channel(cp, x, x, n);
-      cha_firfb_synthesize(cp, x, audio_block->data, n);
-      cha_agc_output(cp, audio_block->data, audio_block->data, n);
-
-      //free up memory
-      //free(x);
+      //do CHA processing with the active program.  Each channel is filtered, compressed, and summed
+      //into the output before the next channel is started, so no per-channel buffer is needed; the
+      //sum then goes through the output compressor and the look-ahead limiter.
+      //Parameter changes published by setCompression() or setFilterbank() are picked up here, and
+      //after setProgram() both programs run for FADE_SAMPLES while one is faded into the other
+      cha_bank_process(&bank, audio_block->data, audio_block->data, n);
 
       //processed audio is returned back through audio_block
     } //end of applyMyAlgorithms
@@ -87,17 +113,130 @@ class AudioEffectMine_F32 : public AudioStream_F32
     float32_t setUserParameter(float val) {
       return user_parameter = val;
     }
+
+    // Switch to another program (0 to NUM_PROGRAMS-1).  The change starts at the next audio
+    // block and is crossfaded, so there is no click.
+    int setProgram(int prog) {
+      if (!active) return 1;
+      return cha_bank_select(&bank, prog);
+    }
+
+    // Call these from the main loop (not from the audio interrupt) to change the fitting of the
+    // selected program while audio is running.  The new values are prepared here and take effect
+    // at the start of the next audio block.  chan < 0 changes the broadband input/output limiter.
+    int setCompression(int chan, float tkgn, float tk, float cr, float bolt) {
+      if (!active) return 1;
+      CHA_PTR cp = bank.cp[bank.req];
+      if (cha_param_begin(cp)) return 1;  //may allocate the second copy of the parameters
+      cha_agc_param(cp, chan, tkgn, tk, cr, bolt);
+      return cha_param_commit(cp);
+    }
+    int setFilterbank(float *firs) {  //CHA_IVAR[_nc] filters of CHA_IVAR[_nw] taps, one after another
+      if (!active) return 1;
+      CHA_PTR cp = bank.cp[bank.req];
+      if (cha_param_begin(cp)) return 1;
+      cha_firfb_param(cp, firs);
+      return cha_param_commit(cp);
+    }
  
   private:
     //state-related variables
     audio_block_f32_t *inputQueueArray_f32[1]; //memory pointer for the input to this module
+    CHA_BANK bank;  //the resident programs & the crossfade between them
+    int active;     //0 = setup failed, the audio is passed through
+
+    //bank, parameter double buffer & output limiter of np programs; on failure the bank is
+    //released, so that the programs can be set up again (with fewer of them)
+    int setupPrograms(CHA_PTR *programs, int np) {
+      if (cha_bank_setup(&bank, programs, np, FADE_SAMPLES)) {
+        cha_bank_cleanup(&bank);
+        return 1;
+      }
+      for (int i = 0; i < np; i++) {
+        CHA_PTR cp = programs[i];
+        if (cha_param_setup(cp) ||  //for changes while audio runs; the first change makes a second copy of the parameters
+            cha_limit_setup(cp, LIMIT_MSEC, CHA_DVAR[_bolt])) {  //catch the transients that overshoot bolt
+          cha_bank_cleanup(&bank);
+          return 1;
+        }
+        CHA_IVAR[_ngs] = GAIN_INTERVAL;
+      }
+      return 0;
+    }
 
     //this value can be set from the outside (such as from the potentiometer) to control
     //a parameter within your algorithm
     float32_t user_parameter = 0.0;  
 
-    //memory for CHA processing
-    float32_t x[CHUNK_SIZE * NUM_FREQ_CHAN * 2];
-
 };  //end class definition for AudioEffectMine_F32
 
+
+
+/*
+   Fixed-point version of the same processing, for targets without an FPU (or where the FPU
+   is slow).  It takes the Int16 blocks straight from the audio input and returns Int16
+   blocks, so the AudioConvert_I16toF32 and AudioConvert_F32toI16 stages (and their extra
+   audio blocks) are not needed.  The float setup is still run once, to convert the
+   prescription; after that, update() uses integer arithmetic only (a prescription that the
+   fixed-point filterbank cannot run, with a chunk shorter than the window, is processed in
+   float instead, and a failed setup passes the audio through).  Against the float
+   processing on carrots.wav & cat.wav the output differs by less than one Int16 step (RMS).
+*/
+class AudioEffectMineQ15 : public AudioStream
+{
+   public:
+    AudioEffectMineQ15(void) : AudioStream(1, inputQueueArray) {
+      CHA_PTR cp = (CHA_PTR) cha_data;
+      mode = MODE_BYPASS;
+      if (cha_data_init(cp)) return;  //state arrays of the prescription
+      if (cha_firfb_setup(cp) || cha_agc_setup(cp)) return;  //float filter responses & compressor tables...
+      CHA_IVAR[_ngs] = GAIN_INTERVAL;
+      mode = MODE_FLOAT;
+      //...converted to fixed point; a prescription the fixed-point filterbank does not support
+      //(chunk shorter than the window) keeps the float processing
+      if (cha_firfb_setup_q(cp) || cha_agc_setup_q(cp)) return;
+      mode = MODE_FIXED;
+    };
+
+    void update(void) {
+      audio_block_t *audio_block = AudioStream::receiveWritable();
+      if (!audio_block) return;
+      applyMyAlgorithm(audio_block);
+      AudioStream::transmit(audio_block);
+      AudioStream::release(audio_block);
+    }
+
+    void applyMyAlgorithm(audio_block_t *audio_block) {
+      CHA_PTR cp = (CHA_PTR) cha_data;
+      int n = CHUNK_SIZE, i, v;
+
+      if (mode == MODE_BYPASS) return;  //setup failed: pass the audio through
+      if (mode == MODE_FLOAT) {
+        for (i = 0; i < n; i++) xf[i] = audio_block->data[i] * (1.0f / 32768.0f);
+        cha_agc_input(cp, xf, xf, n);
+        cha_firfb_process(cp, xf, xf, n);
+        cha_agc_output(cp, xf, xf, n);
+        for (i = 0; i < n; i++) {  //saturated & rounded
+          float s = xf[i] * 32768.0f;
+          audio_block->data[i] = (s >= 32767.0f) ? 32767 : ((s <= -32768.0f) ? -32768 : (int) floorf(s + 0.5f));
+        }
+        return;
+      }
+      for (i = 0; i < n; i++) x[i] = audio_block->data[i] * (1 << (CHA_QS - 15));  //Q15 to Q27
+      cha_agc_input_q(cp, x, x, n);
+      cha_firfb_process_q(cp, x, x, n);
+      cha_agc_output_q(cp, x, x, n);
+      for (i = 0; i < n; i++) {  //Q27 to Q15, rounded & saturated
+        v = (x[i] + (1 << (CHA_QS - 16))) >> (CHA_QS - 15);
+        audio_block->data[i] = (v > 32767) ? 32767 : ((v < -32768) ? -32768 : v);
+      }
+    }
+
+  private:
+    enum { MODE_BYPASS, MODE_FLOAT, MODE_FIXED };
+    audio_block_t *inputQueueArray[1];
+    int mode;             //processing chosen by the constructor
+    int x[CHUNK_SIZE];
+    float xf[CHUNK_SIZE]; //float fallback
+
+};  //end class definition for AudioEffectMineQ15
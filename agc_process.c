@@ -6,171 +6,717 @@
 #include <assert.h>
 #include "chapro.h"
 #include "cha_ff.h"
+#include "cha_simd.h"
+#include "cha_fix.h"
 
-// Choose your math for going into and out of dB space
-//#define db2(x)          ((20/logf(10))*logf(x))
-//#define undb2(x)        expf((x)/(20/logf(10)))
-//#define db2(x)          cha_db2(x)
-//#define undb2(x)        cha_undb2(x)
-#define undb2(x)    (expf(0.1151292546497023f*x))  //faster:  exp(log(10.0f)*(x/20));  this is exact
-#define db2(x)      ((6.020599913279624f)*log2f_approx(x)) //faster: 20*log2_approx(x)/log2(10);  this is approximate
-
-/* ----------------------------------------------------------------------
-** Fast approximation to the log2() function.  It uses a two step
-** process.  First, it decomposes the floating-point number into
-** a fractional component F and an exponent E.  The fraction component
-** is used in a polynomial approximation and then the exponent added
-** to the result.  A 3rd order polynomial is used and the result
-** when computing db20() is accurate to 7.984884e-003 dB.
-** ------------------------------------------------------------------- */
-//https://community.arm.com/tools/f/discussions/4292/cmsis-dsp-new-functionality-proposal/22621#22621
-//float log2f_approx_coeff[4] = {1.23149591368684f, -4.11852516267426f, 6.02197014179219f, -3.13396450166353f};
-static float log2f_approx(float X) {
-  //float *C = &log2f_approx_coeff[0];
-  float Y;
-  float F;
-  int E;
-
-  // This is the approximation to log2()
-  F = frexpf(fabsf(X), &E);
-  //  Y = C[0]*F*F*F + C[1]*F*F + C[2]*F + C[3] + E;
-  //Y = *C++;
-  Y = 1.23149591368684f;
-  Y *= F;
-  //Y += (*C++);
-  Y += -4.11852516267426f;
-  Y *= F;
-  //Y += (*C++);
-  Y += 6.02197014179219f;
-  Y *= F;
-  //Y += (*C++);
-  Y += -3.13396450166353f;
-  Y += E;
-
-  return(Y);
-}
+// All conversions into and out of dB space go through db.c, where the
+// accuracy (exact, polynomial ratio or lookup table) is set at run time
+// with cha_db_method().  The array versions are used per chunk.
+#define db2(x)      cha_db2(x)
+#define undb2(x)    cha_undb2(x)
+
+// Envelopes never decay below ENV_MIN (-481 dB re full scale at 119 dB SPL),
+// so that the release recursion cannot drift into subnormal floats
+// during silence, where many FPUs slow down by an order of magnitude.
+#define ENV_MIN     1e-30f
 
 /***********************************************************/
 
 static __inline void
-smooth_env(float *x, float *y, int n, float *ppk, float alfa, float beta)
+smooth_env(float *x, float *CHA_RESTRICT y, int n, float *ppk, float alfa, 
+    float beta)
 {
-    float  xab, xpk;
+    float  xab, xpk, xat, xrl;
     int k;
 
     // find envelope of x and return as y
     xpk = *ppk;                     // start with previous xpk
     for (k = 0; k < n; k++) {
-	xab = (x[k] >= 0) ? x[k] : -x[k];
-	if (xab >= xpk) {
-            xpk = alfa * xpk + (1-alfa) * xab;
-        } else {
-            xpk = beta * xpk;
-        }
-	y[k] = xpk;
+        xab = fabsf(x[k]);
+        xat = alfa * xpk + (1 - alfa) * xab;    // attack
+        xrl = beta * xpk;                       // release
+        xpk = (xab >= xpk) ? xat : xrl;         // select, no branch
+        xpk = (xpk < ENV_MIN) ? ENV_MIN : xpk;  // floor
+        y[k] = xpk;
     }
     *ppk = xpk;                     // save xpk for next time
 }
 
+// find envelopes of nc channels at once; x holds the channels one after
+// another (nc*cs), y receives the envelopes interleaved by channel (y[i*nc+k]),
+// so that the nc independent envelope recursions run side by side in the
+// SIMD lanes (or, without SIMD, overlap in the FPU pipeline)
 static __inline void
-WDRC_circuit(float *x, float *y, float *pdb, int n, 
-     float tkgn, float tk, float cr, float bolt)
+smooth_env_mc(float *x, float *y, int cs, int nc, float *ppk, 
+    float alfa, float beta)
 {
-    float gdb, tkgo, pblt;
-    int k;
+    float  *yi, xpk, xab;
+    int i, k, k0;
 
+    // interleave magnitudes of all channels
+    for (k = 0; k < nc; k++) {
+        for (i = 0; i < cs; i++) {
+            y[i * nc + k] = fabsf(x[k * cs + i]);
+        }
+    }
+    k = 0;
+#ifdef CHA_SIMD
+    {
+        cha_vf va, vb, vc, vn, vx, vp;
+        cha_vm  m;
+
+        va = vf_dup(alfa);
+        vb = vf_dup(beta);
+        vc = vf_dup(1 - alfa);
+        vn = vf_dup(ENV_MIN);
+        for (; k + CHA_SIMD <= nc; k += CHA_SIMD) {
+            vp = vf_load(ppk + k);
+            for (i = 0; i < cs; i++) {
+                yi = y + i * nc + k;
+                vx = vf_load(yi);
+                m = vf_ge(vx, vp);
+                vp = vf_sel(m, vf_add(vf_mul(va, vp), vf_mul(vc, vx)), vf_mul(vb, vp));
+                vp = vf_max(vp, vn);
+                vf_store(yi, vp);
+            }
+            vf_store(ppk + k, vp);
+        }
+    }
+#endif
+    // remaining channels, sample-major so the recursions interleave
+    if (k < nc) {
+        k0 = k;
+        for (i = 0; i < cs; i++) {
+            yi = y + i * nc;
+            for (k = k0; k < nc; k++) {
+                xab = yi[k];
+                xpk = ppk[k];
+                xpk = (xab >= xpk) ? alfa * xpk + (1 - alfa) * xab : beta * xpk;
+                xpk = (xpk < ENV_MIN) ? ENV_MIN : xpk;
+                ppk[k] = yi[k] = xpk;
+            }
+        }
+    }
+}
+
+// WDRC parameters of one compressor in the form used per sample,
+// derived once from the prescription by agc_par (16 floats, so the
+// records of consecutive compressors stay 64-byte aligned)
+
+typedef struct {
+    float alfa;     // envelope attack coefficient
+    float beta;     // envelope release coefficient
+    float mxdb;     // level (dB SPL) of a full-scale envelope
+    float tkgn;     // gain below the knee (dB)
+    float tk;       // knee (dB SPL), at most bolt - tkgn
+    float cr;       // compression ratio
+    float bolt;     // broadband output limiting threshold (dB SPL)
+    float lin;      // 1 = constant gain below the knee (cr >= 1)
+    float slope;    // gain slope of the compression segment (1/cr - 1)
+    float tkgo;     // gain intercept of the compression segment (dB)
+    float pblt;     // input level where limiting starts (dB SPL)
+    float lmgo;     // gain intercept of the limiting segment (dB)
+    int ktk;        // gain-table step that contains tk, -1 = none
+    int kblt;       // gain-table step that contains pblt, -1 = none
+    float pad[2];
+} WDRC_PAR;
+
+static void
+agc_par(WDRC_PAR *wp, double alfa, double beta, double mxdb, 
+    float tkgn, float tk, float cr, float bolt)
+{
+    memset(wp, 0, sizeof(WDRC_PAR));
     if ((tk + tkgn) > bolt) {
         tk = bolt - tkgn;
     }
-    tkgo = tkgn + tk * (1 - 1 / cr);
-    pblt = cr * (bolt - tkgo);
+    wp->alfa = (float) alfa;
+    wp->beta = (float) beta;
+    wp->mxdb = (float) mxdb;
+    wp->tkgn = tkgn;
+    wp->tk = tk;
+    wp->cr = cr;
+    wp->bolt = bolt;
+    wp->lin = (float) (cr >= 1);
+    wp->slope = (1 / cr) - 1;
+    wp->tkgo = tkgn + tk * (1 - 1 / cr);
+    wp->pblt = cr * (bolt - wp->tkgo);
+    wp->lmgo = bolt - wp->pblt / 10;
+}
+
+// derive parameters of compressor ic (0 = input, 1 = output,
+// 2+k = channel k) from the prescription
+static void
+agc_par_rx(CHA_PTR cp, int ic, WDRC_PAR *wp)
+{
+    int k;
+
+    if (ic < 2) {
+        agc_par(wp, CHA_DVAR[_alfa], CHA_DVAR[_beta], CHA_DVAR[_mxdb],
+            (float) CHA_DVAR[_tkgn], (float) CHA_DVAR[_tk], 
+            (float) CHA_DVAR[_cr], (float) CHA_DVAR[_bolt]);
+    } else {
+        k = ic - 2;
+        agc_par(wp, CHA_DVAR[_gcalfa], CHA_DVAR[_gcbeta], CHA_DVAR[_mxdb],
+            ((float *) cp[_gctkgn])[k], ((float *) cp[_gctk])[k],
+            ((float *) cp[_gccr])[k], ((float *) cp[_gcbolt])[k]);
+    }
+}
+
+// parameters of compressor ic, from the records built by
+// cha_agc_setup or else derived into *tmp
+static __inline WDRC_PAR *
+agc_par_ic(CHA_CTX *cx, int ic, WDRC_PAR *tmp)
+{
+    if (cx->gcpar) {
+        return ((WDRC_PAR *) cx->gcpar + ic);
+    }
+    agc_par_rx(cx->cp, ic, tmp);
+    return (tmp);
+}
+
+// compression curve: gain (dB) for envelope level pdb (dB)
+static __inline float
+WDRC_gain(float pdb, WDRC_PAR *wp)
+{
+    float gdb;
+
+    if ((pdb < wp->tk) && wp->lin) {
+        gdb = wp->tkgn;
+    } else if (pdb > wp->pblt) {
+        gdb = wp->lmgo - 0.9f * pdb;
+    } else {
+        gdb = wp->slope * pdb + wp->tkgo;
+    }
+    return (gdb);
+}
+
+static __inline void
+WDRC_circuit(float *x, float *y, float *pdb, int n, WDRC_PAR *wp)
+{
+    int k;
+
+    for (k = 0; k < n; k++) {
+        pdb[k] = WDRC_gain(pdb[k], wp);
+    }
+    cha_undb2_vec(pdb, pdb, n);
     for (k = 0; k < n; k++) {
-        if ((pdb[k] < tk) && (cr >= 1)) {
-            gdb = tkgn;
-        } else if (pdb[k] > pblt) {
-            gdb = bolt + ((pdb[k] - pblt) / 10) - pdb[k];
+        y[k] = x[k] * pdb[k]; 
+    }
+}
+
+// Gain table: the linear gain as a function of the linear envelope,
+// sampled at the float values whose mantissa has only its top GT_MB
+// bits set, over GT_NO octaves starting at 2^GT_E0.  The table index
+// is then just the exponent & top mantissa bits of the envelope and the
+// remaining mantissa bits give the interpolation weight, so neither
+// frexpf nor expf is needed per sample.  Against the exact curve the
+// gain error is below 0.01 dB (the log2 polynomial used before was 0.008 dB).
+// Interpolating across a knee (tk or pblt) would be off by up to 0.1 dB,
+// and the broadband limiters' knee sits where speech peaks are, so the
+// (at most two) steps that contain a knee, recorded by gain_table in
+// the compressor's WDRC_PAR, evaluate the curve directly instead.
+// Envelopes outside the table range get the gain of the nearest end.
+
+#define GT_MB       4                           // mantissa bits in index
+#define GT_E0       (-24)                       // exponent of first entry
+#define GT_NO       32                          // number of octaves
+#define GT_NT       ((GT_NO << GT_MB) + 1)      // entries per compressor
+
+// table step that contains envelope e (may be out of range)
+static __inline int
+gain_step(float e)
+{
+    union { float f; unsigned int u; } v;
+
+    v.f = e;
+    return ((int) (v.u >> (23 - GT_MB)) - ((127 + GT_E0) << GT_MB));
+}
+
+static __inline float
+gain_lookup(float *tab, float e, WDRC_PAR *wp)
+{
+    union { float f; unsigned int u; } v;
+    float fr;
+    int i;
+
+    v.f = e;
+    i = gain_step(e);
+    if (i < 0) {
+        return (tab[0]);
+    } else if (i >= (GT_NT - 1)) {
+        return (tab[GT_NT - 1]);
+    } else if ((i == wp->ktk) || (i == wp->kblt)) {
+        return (undb2(WDRC_gain(wp->mxdb + db2(e), wp)));
+    }
+    fr = (float) (v.u & ((1 << (23 - GT_MB)) - 1)) * (1.0f / (1 << (23 - GT_MB)));
+    return (tab[i] + fr * (tab[i + 1] - tab[i]));
+}
+
+// table step that contains level pdb (dB SPL), -1 if outside the table
+static int
+gain_knee(double pdb, WDRC_PAR *wp)
+{
+    int i;
+
+    i = gain_step((float) pow(10, (pdb - wp->mxdb) / 20));
+    return (((i >= 0) && (i < (GT_NT - 1))) ? i : -1);
+}
+
+static void
+gain_table(float *tab, WDRC_PAR *wp)
+{
+    double e, gdb, pdb;
+    int j;
+
+    wp->ktk = (wp->lin > 0) ? gain_knee(wp->tk, wp) : -1;
+    wp->kblt = gain_knee(wp->pblt, wp);
+
+    for (j = 0; j < GT_NT; j++) {
+        e = ldexp(1 + (j & ((1 << GT_MB) - 1)) / (double) (1 << GT_MB), 
+            GT_E0 + (j >> GT_MB));
+        pdb = wp->mxdb + 20 * log10(e);
+        gdb = WDRC_gain((float) pdb, wp);
+        tab[j] = (float) pow(10, gdb / 20);
+    }
+}
+
+// control-rate WDRC: the gain is evaluated from the envelope at the
+// last sample of every ng-sample segment and the linear gain is
+// interpolated from the previous value (*pgn), so a steady envelope
+// gives the same gain as WDRC_circuit
+static __inline void
+WDRC_circuit_cr(float *x, float *y, float *CHA_RESTRICT xpk, int n, int ng, 
+    float *pgn, float *CHA_RESTRICT tab, WDRC_PAR *wp)
+{
+    float gdb, pdb, g0, g1, dg;
+    int j, k, nb;
+
+    g0 = *pgn;
+    for (j = 0; j < n; j += ng) {
+        nb = ((n - j) < ng) ? (n - j) : ng;
+        if (tab) {
+            g1 = gain_lookup(tab, xpk[j + nb - 1], wp);
         } else {
-            gdb = ((1 / cr) - 1) * pdb[k] + tkgo;
+            pdb = wp->mxdb + db2(xpk[j + nb - 1]);
+            gdb = WDRC_gain(pdb, wp);
+            g1 = undb2(gdb);
+        }
+        if (g0 < 0) {
+            g0 = g1;                // no previous gain yet
         }
-        y[k] = x[k] * undb2(gdb); 
+        dg = (g1 - g0) / nb;
+        for (k = 0; k < nb; k++) {
+            g0 += dg;
+            y[j + k] = x[j + k] * g0;
+        }
+        g0 = g1;
     }
+    *pgn = g0;                      // save gain for next time
+}
+
+// gain interval of compressor ic: _ngs applies to the channel
+// compressors; the broadband input & output limiters (ic 0/1) attack
+// within a few samples (about 11 for alfa 0.908), faster than a useful
+// control rate, so their gain always follows the envelope per sample
+static __inline int
+agc_ngs(int ic, int ngs)
+{
+    return ((ic < 2) ? 1 : ngs);
 }
 
+// convert envelope to dB and apply wide-dynamic range compression
+// for compressor ic (0 = input, 1 = output, 2+k = channel k); after
+// cha_agc_setup the gain comes from the compressor's gain table and,
+// with a gain interval ng > 1, is computed at control rate
 static __inline void
-compress(CHA_PTR cp, float *x, float *y, int n, float *ppk,
-    float alfa, float beta, float tkgn, float tk, float cr, float bolt)
+compress_env(CHA_CTX *cx, float *x, float *y, int n, int ng, 
+    float *CHA_RESTRICT xpk, int ic, WDRC_PAR *wp)
 {
-    float mxdb, *xpk;
+    float *gn, *CHA_RESTRICT tab;
     int k;
 
-    // find smoothed envelope
-    xpk = (float *) cp[_xpk];
-    smooth_env(x, xpk, n, ppk, alfa, beta);
+    gn = cx->gcgn;
+    tab = cx->gctab;
+    if (tab) {
+        tab += ic * GT_NT;
+    }
+    if (gn && (ng > 1)) {
+        WDRC_circuit_cr(x, y, xpk, n, ng, gn + ic, tab, wp);
+        return;
+    }
+    if (tab) {
+        for (k = 0; k < n; k++) {
+            y[k] = x[k] * gain_lookup(tab, xpk[k], wp);
+        }
+        return;
+    }
     // convert envelope to dB
-    mxdb = (float) CHA_DVAR[_mxdb];
+    cha_db2_vec(xpk, xpk, n);
     for (k = 0; k < n; k++) {
-        xpk[k] = mxdb + db2(xpk[k]);
+        xpk[k] += wp->mxdb;
     }
     // apply wide-dynamic range compression
-    WDRC_circuit(x, y, xpk, n, tkgn, tk, cr, bolt);
+    WDRC_circuit(x, y, xpk, n, wp);
 }
 
+static __inline void
+compress(CHA_CTX *cx, float *x, float *y, int n, float *ppk, int ic)
+{
+    float *CHA_RESTRICT xpk;
+    WDRC_PAR wt, *wp;
+
+    wp = agc_par_ic(cx, ic, &wt);
+    // find smoothed envelope
+    xpk = cx->xpk;
+    smooth_env(x, xpk, n, ppk, wp->alfa, wp->beta);
+    compress_env(cx, x, y, n, agc_ngs(ic, cx->ngs), xpk, ic, wp);
+}
 
 /***********************************************************/
 
+// The CHA_PTR entry points below read a pipeline context (cha_context)
+// and call their _cx versions, which a caller processing several
+// stages per block can use with one context.
+
+FUNC(void)
+cha_agc_input_cx(CHA_CTX *cx, float *x, float *y, int cs)
+{
+    compress(cx, x, y, cs, cx->ppk, 0);  // first ppk for input
+}
+
 FUNC(void)
 cha_agc_input(CHA_PTR cp, float *x, float *y, int cs)
 {
-    float alfa, beta, tkgn, tk, cr, bolt, *ppk;
+    CHA_CTX cx;
 
-    // initialize WDRC variables
-    alfa = (float) CHA_DVAR[_alfa];
-    beta = (float) CHA_DVAR[_beta];
-    tkgn = (float) CHA_DVAR[_tkgn];
-    tk = (float) CHA_DVAR[_tk];
-    cr = (float) CHA_DVAR[_cr];
-    bolt = (float) CHA_DVAR[_bolt];
-    ppk = (float *) cp[_ppk];  // first ppk for input
-    compress(cp, x, y, cs, ppk, alfa, beta, tkgn, tk, cr, bolt);
+    cha_context(cp, &cx);
+    cha_agc_input_cx(&cx, x, y, cs);
 }
 
-FUNC(void)
-cha_agc_channel(CHA_PTR cp, float *x, float *y, int cs)
+// AGC setup: allocate the interleaved envelope buffer used by
+// cha_agc_channel to track all channels at once, the gain state of
+// the compressors used when the gain is computed at control rate
+// (every _ngs samples, see agc_ngs), and derive the
+// parameter record & gain table of each compressor
+FUNC(int)
+cha_agc_setup(CHA_PTR cp)
 {
-    float alfa, beta, *tkgn, *tk, *cr, *bolt, *ppk;
-    float *xk, *yk, *pk;
-    int k, nc;
+    float   *gn, *tab;
+    int      cs, k, nc;
+    WDRC_PAR *wp;
 
-    // initialize WDRC variables
-    alfa = (float) CHA_DVAR[_gcalfa];
-    beta = (float) CHA_DVAR[_gcbeta];
-    tkgn = (float *) cp[_gctkgn];
-    tk = (float *) cp[_gctk];
-    cr = (float *) cp[_gccr];
-    bolt = (float *) cp[_gcbolt];
-    ppk = (float *) cp[_gcppk];
-    // loop over channels
+    cs = CHA_IVAR[_cs];
     nc = CHA_IVAR[_nc];
+    if (cha_allocate(cp, cs * nc, sizeof(float), _gcxpk) == NULL) {
+        return (1);
+    }
+    gn = (float *) cha_allocate(cp, nc + 2, sizeof(float), _gcgn);
+    if (gn == NULL) {
+        return (1);
+    }
+    for (k = 0; k < (nc + 2); k++) {
+        gn[k] = -1;                 // no previous gain
+    }
+    tab = (float *) cha_allocate(cp, (nc + 2) * GT_NT, sizeof(float), _gctab);
+    if (tab == NULL) {
+        return (1);
+    }
+    wp = (WDRC_PAR *) cha_allocate(cp, nc + 2, sizeof(WDRC_PAR), _gcpar);
+    if (wp == NULL) {
+        return (1);
+    }
+    for (k = 0; k < (nc + 2); k++) {
+        agc_par_rx(cp, k, wp + k);
+        gain_table(tab + k * GT_NT, wp + k);
+    }
+
+    return (0);
+}
+
+// compress the nc channels of one segment together (x holds them one
+// after another, nc*n): the envelopes of all channels are found in one
+// pass into env (n*nc, see smooth_env_mc), then each channel gets its
+// gain as in compress, with its envelope copied to xpk (n)
+static __inline void
+compress_mc(CHA_CTX *cx, float *x, float *y, int n, int nc,
+    float *CHA_RESTRICT env, float *CHA_RESTRICT xpk)
+{
+    float *xk, *yk;
+    int i, k;
+    WDRC_PAR wt, *wp;
+
+    wp = agc_par_ic(cx, 2, &wt);
+    smooth_env_mc(x, env, n, nc, cx->gcppk, wp->alfa, wp->beta);
+    // loop over channels
     for (k = 0; k < nc; k++) {
-        xk = x + k * cs;
-        yk = y + k * cs;
-        pk = ppk + k;
-        compress(cp, xk, yk, cs, pk, alfa, beta, tkgn[k], tk[k], cr[k], bolt[k]);
+        xk = x + k * n;
+        yk = y + k * n;
+        for (i = 0; i < n; i++) {
+            xpk[i] = env[i * nc + k];
+        }
+        wp = agc_par_ic(cx, k + 2, &wt);
+        compress_env(cx, xk, yk, n, cx->ngs, xpk, k + 2, wp);
     }
 }
 
+// The channel count & segment sizes of the shipped configurations (see
+// FIRFB_SPEC in firfb_process.c), for which compress_mc is compiled
+// with constant sizes & its workspaces on the stack, so that the
+// channel loops have constant trip counts; other sizes use the
+// run-time sized copy with the workspaces of cha_agc_setup.
+#define AGC_SPEC(X)     X(8, 32) X(8, 128)
+
+#define AGC_CASE(NC, N) \
+    if ((nc == NC) && (cs == N)) { \
+        float env[N * NC], xk[N]; \
+        compress_mc(cx, x, y, N, NC, env, xk); \
+        return; \
+    }
+
+// compress the nc channels of a chunk or segment of cs samples, one
+// after another in x (x and y may be the same array)
+FUNC(void)
+cha_agc_channel_cx(CHA_CTX *cx, float *x, float *y, int cs)
+{
+    float *xk, *yk, *ppk, *env;
+    int k, nc;
+
+    ppk = cx->gcppk;
+    nc = cx->nc;
+    AGC_SPEC(AGC_CASE)
+    env = cx->gcxpk;
+    if ((env == NULL) || (cs > cx->cs)) {
+        // loop over channels
+        for (k = 0; k < nc; k++) {
+            xk = x + k * cs;
+            yk = y + k * cs;
+            compress(cx, xk, yk, cs, ppk + k, k + 2);
+        }
+        return;
+    }
+    compress_mc(cx, x, y, cs, nc, env, cx->xpk);
+}
+
+FUNC(void)
+cha_agc_channel(CHA_PTR cp, float *x, float *y, int cs)
+{
+    CHA_CTX cx;
+
+    cha_context(cp, &cx);
+    cha_agc_channel_cx(&cx, x, y, cs);
+}
+
+// compress one channel (k) of the filterbank output
+FUNC(void)
+cha_agc_chan_cx(CHA_CTX *cx, float *x, float *y, int cs, int k)
+{
+    compress(cx, x, y, cs, cx->gcppk + k, k + 2);
+}
+
+FUNC(void)
+cha_agc_chan(CHA_PTR cp, float *x, float *y, int cs, int k)
+{
+    CHA_CTX cx;
+
+    cha_context(cp, &cx);
+    cha_agc_chan_cx(&cx, x, y, cs, k);
+}
+
+FUNC(void)
+cha_agc_output_cx(CHA_CTX *cx, float *x, float *y, int cs)
+{
+    compress(cx, x, y, cs, cx->ppk + 1, 1);  // second ppk for output
+}
+
 FUNC(void)
 cha_agc_output(CHA_PTR cp, float *x, float *y, int cs)
 {
-    float alfa, beta, tkgn, tk, cr, bolt, *ppk;
-
-    // initialize WDRC variables
-    alfa = (float) CHA_DVAR[_alfa];
-    beta = (float) CHA_DVAR[_beta];
-    tkgn = (float) CHA_DVAR[_tkgn];
-    tk = (float) CHA_DVAR[_tk];
-    cr = (float) CHA_DVAR[_cr];
-    bolt = (float) CHA_DVAR[_bolt];
-    ppk = (float *) cp[_ppk] + 1;   // second ppk for output
-    compress(cp, x, y, cs, ppk, alfa, beta, tkgn, tk, cr, bolt);
+    CHA_CTX cx;
+
+    cha_context(cp, &cx);
+    cha_agc_output_cx(&cx, x, y, cs);
+}
+
+// change the compression curve of channel k (k < 0: input & output
+// limiter) in the staging parameters, see cha_param.c
+FUNC(int)
+cha_agc_param(CHA_PTR cp, int k, float tkgn, float tk, float cr, float bolt)
+{
+    float *tab;
+    int ic, i0, i1, nc;
+    WDRC_PAR *wp;
+
+    wp = (WDRC_PAR *) cp[_gcpars];
+    tab = (float *) cp[_gctabs];
+    nc = CHA_IVAR[_nc];
+    if ((wp == NULL) || (tab == NULL) || (k >= nc)) {
+        return (1);
+    }
+    i0 = (k < 0) ? 0 : k + 2;
+    i1 = (k < 0) ? 1 : k + 2;
+    for (ic = i0; ic <= i1; ic++) {
+        agc_par(wp + ic, wp[ic].alfa, wp[ic].beta, wp[ic].mxdb, tkgn, tk, cr, bolt);
+        gain_table(tab + ic * GT_NT, wp + ic);
+    }
+
+    return (0);
+}
+
+/***********************************************************/
+
+// fixed-point compressors (see cha_fix.h): the envelope recursion runs
+// on CHA_QS envelopes with Q31 constants, and the gain comes from a
+// Q23 copy of each compressor's gain table, indexed by the position of
+// the envelope's leading one bit and the GT_MB bits below it, i.e.
+// the integer counterpart of gain_lookup, so no log or exp is needed
+
+// per compressor: Q31 alfa, 1 - alfa & beta (constants, _gcqpar)
+#define QP_ALFA     0
+#define QP_CALF     1
+#define QP_BETA     2
+#define QP_SIZE     4
+
+// per compressor: envelope & gain state (_gcqst)
+#define QS_PPK      0
+#define QS_GN       1
+#define QS_SIZE     2
+
+static __inline void
+smooth_env_q(int *x, int *y, int n, int *qp, int *qs)
+{
+    int      k, xab, xpk;
+
+    xpk = qs[QS_PPK];
+    for (k = 0; k < n; k++) {
+        xab = (x[k] < 0) ? -x[k] : x[k];
+        if (xab >= xpk) {
+            xpk = (int) (((cha_i64) qp[QP_ALFA] * xpk 
+                + (cha_i64) qp[QP_CALF] * xab) >> 31);  // attack
+        } else {
+            xpk = cha_mulq31(qp[QP_BETA], xpk);         // release
+        }
+        xpk = (xpk < 1) ? 1 : xpk;
+        y[k] = xpk;
+    }
+    qs[QS_PPK] = xpk;
+}
+
+static __inline int
+gain_lookup_q(int *tab, int e)
+{
+    unsigned int m;
+    int      b, i, nf;
+
+    b = 31 - cha_clz((unsigned int) e);
+    m = (unsigned int) e - (1u << b);
+    nf = b - GT_MB;
+    i = ((b - CHA_QS - GT_E0) << GT_MB) + ((nf >= 0) ? (int) (m >> nf) : (int) (m << -nf));
+    if (i < 0) {
+        return (tab[0]);
+    } else if (i >= (GT_NT - 1)) {
+        return (tab[GT_NT - 1]);
+    }
+    if (nf <= 0) {
+        return (tab[i]);
+    }
+    m &= (1u << nf) - 1;
+    return (tab[i] + (int) (((cha_i64) (tab[i + 1] - tab[i]) * m) >> nf));
+}
+
+static void
+compress_q(CHA_PTR cp, int *x, int *y, int n, int ic)
+{
+    int      j, k, nb, ng, g0, g1, dg, *qp, *qs, *tab, *xpk;
+
+    qp = (int *) cp[_gcqpar] + ic * QP_SIZE;
+    qs = (int *) cp[_gcqst] + ic * QS_SIZE;
+    tab = (int *) cp[_gcqtab] + ic * GT_NT;
+    xpk = (int *) cp[_gcqxpk];
+    smooth_env_q(x, xpk, n, qp, qs);
+    ng = agc_ngs(ic, CHA_IVAR[_ngs]);
+    if (ng <= 1) {
+        for (k = 0; k < n; k++) {
+            y[k] = cha_sat32(((cha_i64) x[k] * gain_lookup_q(tab, xpk[k])) >> CHA_QG);
+        }
+        return;
+    }
+    // control rate, as WDRC_circuit_cr
+    g0 = qs[QS_GN];
+    for (j = 0; j < n; j += ng) {
+        nb = ((n - j) < ng) ? (n - j) : ng;
+        g1 = gain_lookup_q(tab, xpk[j + nb - 1]);
+        if (g0 < 0) {
+            g0 = g1;                // no previous gain yet
+        }
+        dg = (g1 - g0) / nb;
+        for (k = 0; k < nb; k++) {
+            g0 += dg;
+            y[j + k] = cha_sat32(((cha_i64) x[j + k] * g0) >> CHA_QG);
+        }
+        g0 = g1;
+    }
+    qs[QS_GN] = g0;
+}
+
+// fixed-point compressor setup: constants, Q23 gain tables & state
+// from the float ones; requires cha_agc_setup, and is repeated after
+// cha_agc_param changes
+FUNC(int)
+cha_agc_setup_q(CHA_PTR cp)
+{
+    double   g;
+    float   *tab;
+    int      cs, ic, j, nc, *qp, *qs, *tq;
+    WDRC_PAR *wp;
+
+    cs = CHA_IVAR[_cs];
+    nc = CHA_IVAR[_nc];
+    wp = (WDRC_PAR *) cp[_gcpar];
+    tab = (float *) cp[_gctab];
+    if ((wp == NULL) || (tab == NULL)) {
+        return (1);
+    }
+    qp = (int *) cha_allocate(cp, (nc + 2) * QP_SIZE, sizeof(int), _gcqpar);
+    qs = (int *) cha_allocate(cp, (nc + 2) * QS_SIZE, sizeof(int), _gcqst);
+    tq = (int *) cha_allocate(cp, (nc + 2) * GT_NT, sizeof(int), _gcqtab);
+    if ((qp == NULL) || (qs == NULL) || (tq == NULL)) {
+        return (1);
+    }
+    if (cha_allocate(cp, cs, sizeof(int), _gcqxpk) == NULL) {
+        return (1);
+    }
+    for (ic = 0; ic < (nc + 2); ic++) {
+        qp[QP_ALFA] = cha_q31(wp[ic].alfa);
+        qp[QP_CALF] = cha_q31(1 - wp[ic].alfa);
+        qp[QP_BETA] = cha_q31(wp[ic].beta);
+        qs[QS_PPK] = 1;
+        qs[QS_GN] = -1;             // no previous gain
+        qp += QP_SIZE;
+        qs += QS_SIZE;
+        for (j = 0; j < GT_NT; j++) {
+            g = ldexp(tab[ic * GT_NT + j], CHA_QG);
+            tq[ic * GT_NT + j] = (g >= CHA_Q31) ? 2147483647 : (int) (g + 0.5);
+        }
+    }
+
+    return (0);
+}
+
+FUNC(void)
+cha_agc_input_q(CHA_PTR cp, int *x, int *y, int cs)
+{
+    compress_q(cp, x, y, cs, 0);
+}
+
+// compress one channel (k) of the fixed-point filterbank output
+FUNC(void)
+cha_agc_chan_q(CHA_PTR cp, int *x, int *y, int cs, int k)
+{
+    compress_q(cp, x, y, cs, k + 2);
+}
+
+FUNC(void)
+cha_agc_output_q(CHA_PTR cp, int *x, int *y, int cs)
+{
+    compress_q(cp, x, y, cs, 1);
 }
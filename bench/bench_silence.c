@@ -0,0 +1,155 @@
+// bench_silence.c - per-block processing cost across speech & silence
+//
+// Host benchmark, not part of the sketch.  Build from this folder with
+//
+//   cc -O2 -I.. -o bench_silence bench_silence.c ../agc_process.c
+//       ../cha_core.c ../cha_scale.c ../db.c ../firfb_process.c ../rfft.c
+//       ../rfftq.c -lm
+//
+// (one command line) and run as
+//
+//   bench_silence [-n] [-s seconds] [wavfile]
+//
+// The input is the WAV file (default ../carrots.wav), followed by the
+// given seconds (default 30) of digital silence, followed by the WAV
+// file again.  The pipeline is the same as the sketch's.  The mean and
+// worst per-block times are printed for each segment; with the
+// denormal-safe state these should be the same during speech and
+// after long silence.  The -n option runs without the FPU guard.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "chapro.h"
+#include "cha_ff.h"
+#include "cha_ff_data128.h"
+
+#define GAIN_INTERVAL   8
+
+/***********************************************************/
+
+static float *
+read_wav(char *fn, int *nsmp)
+{
+    unsigned char hdr[44];
+    short *s;
+    float *x;
+    int i, n;
+    FILE *fp;
+
+    fp = fopen(fn, "rb");
+    if (fp == NULL) {
+        return (NULL);
+    }
+    // assume canonical 16-bit mono PCM header
+    if (fread(hdr, 1, 44, fp) != 44) {
+        fclose(fp);
+        return (NULL);
+    }
+    n = (hdr[40] | (hdr[41] << 8) | (hdr[42] << 16) | (hdr[43] << 24)) / 2;
+    s = (short *) calloc(n, sizeof(short));
+    n = (int) fread(s, sizeof(short), n, fp);
+    fclose(fp);
+    x = (float *) calloc(n, sizeof(float));
+    for (i = 0; i < n; i++) {
+        x[i] = s[i] / 32768.0f;
+    }
+    free(s);
+    *nsmp = n;
+    return (x);
+}
+
+static double
+usec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1e6 + ts.tv_nsec * 1e-3);
+}
+
+/***********************************************************/
+
+int
+main(int ac, char **av)
+{
+    char *fn = "../carrots.wav";
+    float *w, *x, *y;
+    double t, tsum[4], tmax[4], fs;
+    int i, j, b, cs, nw, ns, nb, seg, guard = 1, nsil = 30, cnt[4];
+    unsigned int fpu = 0;
+    CHA_PTR cp;
+    static char *name[4] = {
+        "speech", "silence, first 1 s", "silence, last 5 s", "speech again"
+    };
+
+    for (i = 1; i < ac; i++) {
+        if (strcmp(av[i], "-n") == 0) {
+            guard = 0;
+        } else if ((strcmp(av[i], "-s") == 0) && ((i + 1) < ac)) {
+            nsil = atoi(av[++i]);
+        } else {
+            fn = av[i];
+        }
+    }
+    w = read_wav(fn, &nw);
+    if (w == NULL) {
+        fprintf(stderr, "can't read %s\n", fn);
+        return (1);
+    }
+    cp = (CHA_PTR) cha_data;
+    cha_data_init(cp);
+    cs = CHA_IVAR[_cs];
+    fs = CHA_DVAR[_fs];
+    cha_firfb_setup(cp);
+    cha_agc_setup(cp);
+    CHA_IVAR[_ngs] = GAIN_INTERVAL;
+    // speech, silence, speech
+    ns = (int) (nsil * fs);
+    nb = (nw + ns + nw) / cs;
+    x = (float *) calloc(nb * cs, sizeof(float));
+    y = (float *) calloc(cs, sizeof(float));
+    fcopy(x, w, nw);
+    fcopy(x + nw + ns, w, nb * cs - nw - ns);
+    memset(cnt, 0, sizeof(cnt));
+    memset(tsum, 0, sizeof(tsum));
+    memset(tmax, 0, sizeof(tmax));
+    for (b = 0; b < nb; b++) {
+        j = b * cs;
+        if (j < nw) {
+            seg = 0;
+        } else if (j < (nw + fs)) {
+            seg = 1;
+        } else if (j < (nw + ns - 5 * fs)) {
+            seg = -1;
+        } else if (j < (nw + ns)) {
+            seg = 2;
+        } else {
+            seg = 3;
+        }
+        fcopy(y, x + j, cs);
+        t = usec();
+        if (guard) fpu = cha_fpu_guard();
+        cha_agc_input(cp, y, y, cs);
+        cha_firfb_process(cp, y, y, cs);
+        cha_agc_output(cp, y, y, cs);
+        if (guard) cha_fpu_restore(fpu);
+        t = usec() - t;
+        if (seg < 0) continue;
+        cnt[seg]++;
+        tsum[seg] += t;
+        if (tmax[seg] < t) tmax[seg] = t;
+    }
+    printf("%s, %d s silence, cs=%d, FPU guard %s\n", fn, nsil, cs,
+        guard ? "on" : "off");
+    for (i = 0; i < 4; i++) {
+        printf("%-20s %6d blocks  mean %8.2f us  max %8.2f us\n", name[i],
+            cnt[i], cnt[i] ? tsum[i] / cnt[i] : 0, tmax[i]);
+    }
+    free(w);
+    free(x);
+    free(y);
+
+    return (0);
+}
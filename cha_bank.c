@@ -0,0 +1,174 @@
+// cha_bank.c - resident presets with crossfaded switching
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include "chapro.h"
+#include "cha_ff.h"
+
+// Several prescriptions (programs) stay set up at once.  They must
+// have the same chunk size & window size, so that they can share one
+// FFT plan and one workspace (cha_firfb_share); each keeps its own
+// filter & compressor state and coefficients.  Only the active preset
+// is processed.  cha_bank_select requests another preset, which is
+// taken at the next block boundary and faded in with an equal-power
+// crossfade of nf samples, during which both presets are processed.
+// A preset that was idle resumes from its old state, so it is first
+// run for one block with its output muted, which lets its compressor
+// envelopes catch up with the signal and flushes the filter overlap.
+
+/***********************************************************/
+
+// one block through a preset's pipeline (x and y may be the same);
+// the context is read after the parameter swap
+static __inline void
+bank_run(CHA_PTR cp, float *x, float *y, int cs)
+{
+    CHA_CTX cx;
+
+    cha_param_sync(cp);
+    cha_context(cp, &cx);
+    cha_agc_input_cx(&cx, x, y, cs);
+    cha_firfb_process_cx(&cx, y, y, cs);
+    cha_agc_output_cx(&cx, y, y, cs);
+    cha_limit_process(cp, y, y, cs);
+}
+
+/***********************************************************/
+
+// set up the filterbank & compressors of np presets, the first of
+// which owns the shared FFT plan & workspace; nf is the crossfade
+// length in samples (0 = switch at once)
+FUNC(int)
+cha_bank_setup(CHA_BANK *bk, CHA_PTR *cp, int np, int nf)
+{
+    double   a;
+    int      i, j, cs;
+
+    memset(bk, 0, sizeof(CHA_BANK));
+    if ((np < 1) || (np > CHA_MXPRE) || (cp[0] == NULL)) {
+        return (1);
+    }
+    for (i = 0; i < np; i++) {
+        if (cp[i] == NULL) {
+            return (1);
+        }
+        bk->cp[i] = cp[i];
+        bk->np = i + 1;     // for cha_bank_cleanup after a failure
+        if ((i == 0) ? cha_firfb_setup(cp[i]) : cha_firfb_share(cp[i], cp[0])) {
+            return (1);
+        }
+        if (cha_agc_setup(cp[i])) {
+            return (1);
+        }
+    }
+    cs = ((int *) cp[0][_ivar])[_cs];
+    nf = (nf > 0) ? nf : 0;
+    bk->xb = (float *) calloc(cs, sizeof(float));
+    bk->fw = (float *) calloc(nf + 1, sizeof(float));
+    if ((bk->xb == NULL) || (bk->fw == NULL)) {
+        cha_bank_cleanup(bk);
+        return (1);
+    }
+    for (j = 0; j <= nf; j++) {
+        a = (nf > 0) ? (M_PI / 2) * j / nf : (M_PI / 2);
+        bk->fw[j] = (float) sin(a);
+    }
+    bk->cs = cs;
+    bk->nf = nf;
+    bk->nxt = -1;
+
+    return (0);
+}
+
+// request preset ip (any thread); takes effect at the start of the
+// next block, or after the crossfade in progress
+FUNC(int)
+cha_bank_select(CHA_BANK *bk, int ip)
+{
+    if ((ip < 0) || (ip >= bk->np)) {
+        return (1);
+    }
+    bk->req = ip;
+
+    return (0);
+}
+
+// process one block with the active preset, crossfading to the
+// requested one (x and y may be the same array)
+FUNC(void)
+cha_bank_process(CHA_BANK *bk, float *x, float *y, int cs)
+{
+    float   *fi, *fo, *xb;
+    int      i, n, ip;
+
+    assert(cs <= bk->cs);
+    // start a switch at the block boundary
+    if (bk->nxt < 0) {
+        ip = bk->req;
+        if (ip != bk->cur) {
+            if (bk->nf > 0) {
+                bk->nxt = ip;
+                bk->jf = -1;
+            } else {
+                bk->cur = ip;
+            }
+        }
+    }
+    if (bk->nxt < 0) {
+        bank_run(bk->cp[bk->cur], x, y, cs);
+        return;
+    }
+    // both presets during the crossfade
+    xb = bk->xb;
+    fcopy(xb, x, cs);
+    bank_run(bk->cp[bk->cur], x, y, cs);
+    bank_run(bk->cp[bk->nxt], xb, xb, cs);
+    if (bk->jf < 0) {
+        bk->jf = 0;         // warm-up block, incoming preset muted
+        return;
+    }
+    n = bk->nf - bk->jf;
+    if (n > cs) {
+        n = cs;
+    }
+    fi = bk->fw + bk->jf + 1;
+    fo = bk->fw + bk->nf - bk->jf - 1;
+    for (i = 0; i < n; i++) {
+        y[i] = y[i] * fo[-i] + xb[i] * fi[i];
+    }
+    for (; i < cs; i++) {
+        y[i] = xb[i];
+    }
+    bk->jf += n;
+    if (bk->jf >= bk->nf) {
+        bk->cur = bk->nxt;
+        bk->nxt = -1;
+    }
+}
+
+// free the crossfade buffers and detach the shared filterbank
+// arrays from all but the first preset; the presets themselves
+// belong to the caller
+FUNC(void)
+cha_bank_cleanup(CHA_BANK *bk)
+{
+    int      i, j, *cpsiz;
+    static int shared[] = {_ffpl, _ffai, _ffwk, _ffch};
+    static int nshared = sizeof(shared) / sizeof(int);
+
+    for (i = 1; i < bk->np; i++) {
+        cpsiz = (int *) bk->cp[i][_size];
+        for (j = 0; j < nshared; j++) {
+            if (bk->cp[i][shared[j]] != bk->cp[0][shared[j]]) continue;
+            bk->cp[i][shared[j]] = NULL;
+            cpsiz[shared[j]] = 0;
+        }
+    }
+    if (bk->xb) free(bk->xb);
+    if (bk->fw) free(bk->fw);
+    bk->xb = NULL;
+    bk->fw = NULL;
+    bk->np = 0;
+}
@@ -2,12 +2,147 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define HAVE_MMAP
+#endif
 #include "chapro.h"
+#include "cha_ff.h"
 #include "version.h"
 
 #define free_null(p)    if(p){free(p);p=NULL;}
 
+// floating-point control register & its flush-to-zero bits
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define FPU_FTZ         0x8040      // MXCSR: flush-to-zero, denormals-are-zero
+#define fpu_get()       _mm_getcsr()
+#define fpu_set(c)      _mm_setcsr(c)
+#elif defined(__aarch64__)
+#define FPU_FTZ         (1 << 24)   // FPCR.FZ
+static __inline unsigned int 
+fpu_get(void) { unsigned long c; __asm__ volatile ("mrs %0, fpcr" : "=r" (c)); return ((unsigned int) c); }
+static __inline void 
+fpu_set(unsigned int c) { unsigned long v = c; __asm__ volatile ("msr fpcr, %0" : : "r" (v)); }
+#elif defined(__arm__) && defined(__ARM_FP)
+#define FPU_FTZ         (1 << 24)   // FPSCR.FZ
+static __inline unsigned int 
+fpu_get(void) { unsigned int c; __asm__ volatile ("vmrs %0, fpscr" : "=r" (c)); return (c); }
+static __inline void 
+fpu_set(unsigned int c) { __asm__ volatile ("vmsr fpscr, %0" : : "r" (c)); }
+#else
+#define FPU_FTZ         0           // no control over subnormals
+#define fpu_get()       0
+#define fpu_set(c)
+#endif
+
+/***********************************************************/
+
+// The block at _arena starts with this header.  It holds the packed
+// arrays (cha_arena_pack) and records the arrays that the pipeline
+// borrows: those of a prescription image (cha_data_load, cha_data_image)
+// and the arrays of a generated header (cha_data_init).  Borrowed
+// arrays are never freed or moved and may be read-only, so a module
+// that changes one in place first takes a copy (cha_writable).
+
+#define IMAGE_CALLER    0       // caller's memory, e.g. flash
+#define IMAGE_MAP       1       // mapped file, unmapped by cha_cleanup
+#define IMAGE_HEAP      2       // file read into the heap, freed by cha_cleanup
+
+typedef struct {
+    char *base;         // packed arrays
+    size_t nb;
+    char *img;          // prescription image
+    size_t ni;
+    int kind;           // IMAGE_CALLER, IMAGE_MAP or IMAGE_HEAP
+    void *map;          // mapping or heap block to release, & length
+    size_t len;
+    char bw[NPTR];      // other arrays cp does not own (cha_data_init)
+    int nref;           // shared prescription: 1 + number of instances
+    void **keep;        // its arrays, after cha_cleanup with instances left
+    void *src;          // instance: arena of the shared prescription
+} CHA_ARENA;
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define ref_add(p,v)    (_InterlockedExchangeAdd((long volatile *)(p), v) + (v))
+#else
+#define ref_add(p,v)    __atomic_add_fetch(p, v, __ATOMIC_ACQ_REL)
+#endif
+
+#define align_up(a)     (((size_t) (a) + CHA_ALIGN - 1) & ~((size_t) CHA_ALIGN - 1))
+#define in_span(p,a,n)  ((a) && ((char *) (p) >= (a)) && ((char *) (p) < (a) + (n)))
+
+// is p one of the packed arrays?
+static __inline int
+arena_owns(CHA_ARENA *ar, void *p)
+{
+    return (ar && in_span(p, ar->base, ar->nb));
+}
+
+// is slot i an array that cp borrows?
+static __inline int
+arena_borrowed(CHA_ARENA *ar, CHA_PTR cp, int i)
+{
+    return (ar && cp[i] && (ar->bw[i] || in_span(cp[i], ar->img, ar->ni)));
+}
+
+// new arena header followed by nb bytes of aligned, zeroed space,
+// taking over the borrowed arrays recorded by the old header
+static CHA_ARENA *
+arena_new(CHA_ARENA *old, size_t nb)
+{
+    CHA_ARENA *ar;
+
+    ar = (CHA_ARENA *) calloc(sizeof(CHA_ARENA) + CHA_ALIGN - 1 + nb, 1);
+    if (ar == NULL) {
+        return (NULL);
+    }
+    if (old) {
+        memcpy(ar, old, sizeof(CHA_ARENA));
+    }
+    ar->base = (char *) align_up(ar + 1);
+    ar->nb = nb;
+    return (ar);
+}
+
+// install the arena header ar in place of the old one
+static void
+arena_set(CHA_PTR cp, CHA_ARENA *ar)
+{
+    if (cp[_arena]) free(cp[_arena]);
+    cp[_arena] = ar;
+    ((int *)cp[_size])[_arena] = (int) (sizeof(CHA_ARENA) + CHA_ALIGN - 1 + ar->nb);
+}
+
+// release the arena header & the image it holds (not the pointers
+// into them)
+static void
+arena_free(CHA_PTR cp)
+{
+    CHA_ARENA *ar = (CHA_ARENA *) cp[_arena];
+
+    if (ar == NULL) {
+        return;
+    }
+  #ifdef HAVE_MMAP
+    if (ar->kind == IMAGE_MAP) {
+        munmap(ar->map, ar->len);
+    }
+  #endif
+    if (ar->kind == IMAGE_HEAP) {
+        free(ar->map);
+    }
+    free(ar);
+    cp[_arena] = NULL;
+}
+
 /***********************************************************/
 
 FUNC(char *) 
@@ -32,30 +167,362 @@ cha_prepare(CHA_PTR cp)
 FUNC(void *) 
 cha_allocate(CHA_PTR cp, int cnt, int siz, int idx)
 {
+    CHA_ARENA *ar;
+
     cha_prepare(cp);
     assert(idx < NPTR);
+    ar = (CHA_ARENA *) cp[_arena];
+    if (arena_owns(ar, cp[idx]) || arena_borrowed(ar, cp, idx)) {
+        cp[idx] = NULL;     // not ours to free
+        ar->bw[idx] = 0;
+    }
     free_null(cp[idx]);
-    cp[idx] = calloc(cnt, siz);
+    cp[idx] = (cnt > 0) ? calloc(cnt, siz) : NULL;  // 0 empties the slot
     ((int *)cp[_size])[idx] = cnt * siz;
 
     return (cp[idx]);
 };
 
+// make array idx writable: a borrowed array (see cha_data_init) is
+// replaced by a copy that cp owns
+FUNC(void *) 
+cha_writable(CHA_PTR cp, int idx)
+{
+    void *bw;
+    int siz;
+
+    bw = cp[idx];
+    if ((bw == NULL) || !arena_borrowed((CHA_ARENA *) cp[_arena], cp, idx)) {
+        return (bw);
+    }
+    siz = ((int *)cp[_size])[idx];
+    if (cha_allocate(cp, siz, 1, idx) == NULL) {
+        return (NULL);
+    }
+    memcpy(cp[idx], bw, siz);
+
+    return (cp[idx]);
+};
+
+// does cp borrow array idx (see cha_data_init, cha_instance)?
+FUNC(int) 
+cha_borrowed(CHA_PTR cp, int idx)
+{
+    return (arena_borrowed((CHA_ARENA *) cp[_arena], cp, idx));
+};
+
+// exchange arrays a & b of cp, with their sizes and ownership (see
+// cha_param_sync); no memory is allocated or freed
+FUNC(void) 
+cha_swap(CHA_PTR cp, int a, int b)
+{
+    void *p;
+    int n, *cpsiz;
+    char c;
+    CHA_ARENA *ar;
+
+    p = cp[a];
+    cp[a] = cp[b];
+    cp[b] = p;
+    cpsiz = (int *) cp[_size];
+    n = cpsiz[a];
+    cpsiz[a] = cpsiz[b];
+    cpsiz[b] = n;
+    ar = (CHA_ARENA *) cp[_arena];
+    if (ar) {
+        c = ar->bw[a];
+        ar->bw[a] = ar->bw[b];
+        ar->bw[b] = c;
+    }
+};
+
+// duplicate a pipeline: every array of src is copied into newly
+// allocated memory, which cha_cleanup releases
+FUNC(CHA_PTR) 
+cha_copy(CHA_PTR src)
+{
+    int i, *srcsiz;
+    CHA_PTR cp;
+
+    srcsiz = (int *) src[_size];
+    if (srcsiz == NULL) {
+        return (NULL);
+    }
+    cp = (CHA_PTR) calloc(NPTR, sizeof(void *));
+    if (cp == NULL) {
+        return (NULL);
+    }
+    for (i = 0; i < NPTR; i++) {
+        if ((src[i] == NULL) || (srcsiz[i] <= 0) || (i == _arena)) continue;
+        cp[i] = malloc(srcsiz[i]);
+        if (cp[i] == NULL) {
+            cha_cleanup(cp);
+            free(cp);
+            return (NULL);
+        }
+        memcpy(cp[i], src[i], srcsiz[i]);
+    }
+    ((int *)cp[_size])[_arena] = 0;
+
+    return (cp);
+};
+
+// Arena: after setup, cha_arena_pack moves every array that cp owns of a
+// pipeline into one block, each aligned to CHA_ALIGN bytes.  The nhot
+// arrays listed in hot (the state touched by every block, see
+// CHA_FF_STATE) come first, so that they share cache lines & pages,
+// followed by the coefficients & tables in pointer-index order.  The
+// old arrays are freed, so they must have come from cha_allocate or
+// cha_copy; borrowed arrays stay where they are, and so do arrays
+// that cp shares with shr (e.g. cha_firfb_share).  The owner of
+// shared arrays must not be packed after sharing.  The block is kept
+// at _arena and cha_cleanup frees it with one call.  Packing again
+// (after more arrays were allocated) builds a new block.
+FUNC(int) 
+cha_arena_pack(CHA_PTR cp, int *hot, int nhot, CHA_PTR shr)
+{
+    char *a;
+    int i, j, k, n, *cpsiz, ord[NPTR];
+    size_t nb, off[NPTR];
+    CHA_ARENA *ar, *a0;
+
+    cpsiz = (int *) cp[_size];
+    if (cpsiz == NULL) {
+        return (1);
+    }
+    a0 = (CHA_ARENA *) cp[_arena];    // previous arena, if any
+    if (a0 && (a0->nref > 0)) {
+        return (1);         // instances point into the arrays
+    }
+    // layout: hot state first, then everything else
+    for (i = 0; i < NPTR; i++) {
+        off[i] = (size_t) -1;
+    }
+    n = 0;
+    nb = 0;
+    for (j = 0; j < nhot + NPTR; j++) {
+        i = (j < nhot) ? hot[j] : j - nhot;
+        if ((i < 0) || (i >= NPTR) || (i == _arena) || (off[i] != (size_t) -1)) continue;
+        if ((cp[i] == NULL) || (cpsiz[i] <= 0) || arena_borrowed(a0, cp, i)) continue;
+        if (shr && (shr != cp) && (cp[i] == shr[i])) continue;
+        off[i] = nb;
+        ord[n++] = i;
+        nb += align_up(cpsiz[i]);
+    }
+    ar = arena_new(a0, nb);
+    if (ar == NULL) {
+        return (1);
+    }
+    a = ar->base;
+    for (k = 0; k < n; k++) {
+        i = ord[k];
+        memcpy(a + off[i], cp[i], cpsiz[i]);
+    }
+    // release the old arrays, then point at the packed ones
+    for (k = 0; k < n; k++) {
+        i = ord[k];
+        if (!arena_owns(a0, cp[i])) {
+            free(cp[i]);
+        }
+        cp[i] = a + off[i];
+    }
+    arena_set(cp, ar);
+
+    return (0);
+};
+
+// Shared prescription: cha_instance makes a pipeline that owns copies
+// of the variables, of every array written per block (CHA_FF_STATE)
+// and of the nown further arrays listed in own, taken from rx as they
+// are, and borrows every other array of the set-up pipeline rx:
+// filter responses, FFT plans, compressor tables.  So many instances
+// with independent audio cost one set of coefficients.  The parameter
+// mailbox & staging copies of rx are not taken: an instance that
+// changes its parameters calls cha_param_setup & cha_param_begin,
+// which give it copies of its own.  rx counts its instances and, when
+// it is cleaned up first, keeps the shared arrays until the last
+// instance is cleaned up.  Instances may be cleaned up from any
+// thread, but are made from one thread; rx must not be an instance
+// itself, and must not be changed (set up again, packed or given new
+// parameters) while it has instances.
+FUNC(CHA_PTR) 
+cha_instance(CHA_PTR rx, int *own, int nown)
+{
+    signed char mine[NPTR];
+    int i, *rxsiz;
+    static int state[] = {CHA_FF_STATE};
+    static int nstate = sizeof(state) / sizeof(int);
+    static int param[] = {_pmbx, _ffhhs, _gcpars, _gctabs};
+    static int nparam = sizeof(param) / sizeof(int);
+    CHA_PTR cp;
+    CHA_ARENA *ra, *ar;
+
+    rxsiz = (int *) rx[_size];
+    if (rxsiz == NULL) {
+        return (NULL);
+    }
+    ra = (CHA_ARENA *) rx[_arena];
+    if (ra == NULL) {
+        ra = arena_new(NULL, 0);
+        if (ra) arena_set(rx, ra);
+    }
+    cp = (CHA_PTR) calloc(NPTR, sizeof(void *));
+    ar = arena_new(NULL, 0);
+    if ((ra == NULL) || ra->src || (cp == NULL) || (ar == NULL)) {
+        if (cp) free(cp);
+        if (ar) free(ar);
+        return (NULL);
+    }
+    for (i = 0; i < NPTR; i++) {
+        mine[i] = (i < _reserve);
+    }
+    for (i = 0; i < nstate; i++) {
+        mine[state[i]] = 1;
+    }
+    for (i = 0; i < nown; i++) {
+        if ((own[i] >= 0) && (own[i] < NPTR)) mine[own[i]] = 1;
+    }
+    for (i = 0; i < nparam; i++) {
+        mine[param[i]] = -1;        // left out
+    }
+    cp[_arena] = ar;
+    for (i = 0; i < NPTR; i++) {
+        if ((i == _arena) || (rx[i] == NULL) || (rxsiz[i] <= 0)) continue;
+        if (mine[i] < 0) {
+            ((int *)cp[_size])[i] = 0;
+            continue;
+        }
+        if (!mine[i]) {
+            cp[i] = rx[i];
+            ar->bw[i] = 1;
+            continue;
+        }
+        cp[i] = malloc(rxsiz[i]);
+        if (cp[i] == NULL) {
+            cha_cleanup(cp);
+            free(cp);
+            return (NULL);
+        }
+        memcpy(cp[i], rx[i], rxsiz[i]);
+    }
+    ((int *)cp[_size])[_arena] = (int) (sizeof(CHA_ARENA) + CHA_ALIGN - 1);
+    if (ra->nref == 0) {
+        ra->nref = 1;       // the reference of rx itself
+    }
+    ref_add(&ra->nref, 1);
+    ar->src = ra;
+
+    return (cp);
+};
+
+// drop a reference to a shared prescription; the last one frees it
+static void
+rx_unref(CHA_ARENA *ra)
+{
+    void **keep;
+
+    if (ref_add(&ra->nref, -1) > 0) {
+        return;
+    }
+    keep = ra->keep;
+    if (keep) {
+        cha_cleanup(keep);
+        free(keep);
+    }
+}
+
 FUNC(void) 
 cha_cleanup(CHA_PTR cp)
 {
     int i;
+    void **keep;
+    CHA_ARENA *ar, *src;
 
+    ar = (CHA_ARENA *) cp[_arena];
+    if (ar && (ar->nref > 0) && (ar->keep == NULL)) {
+        // prescription with instances: hand the arrays to the last one
+        // (or, without memory for that, leave them to the instances)
+        keep = (void **) malloc(NPTR * sizeof(void *));
+        if (keep) {
+            memcpy(keep, cp, NPTR * sizeof(void *));
+            ar->keep = keep;
+        }
+        memset(cp, 0, NPTR * sizeof(void *));
+        if (keep) {
+            rx_unref(ar);
+        }
+        return;
+    }
+    src = ar ? (CHA_ARENA *) ar->src : NULL;
     for (i = 0; i < NPTR; i++) {
+        if (i == _arena) continue;
+        if (arena_owns(ar, cp[i]) || arena_borrowed(ar, cp, i)) {
+            cp[i] = NULL;       // freed with the arena, or not ours
+        }
         free_null(cp[i]);
     }
+    arena_free(cp);
+    if (src) {
+        rx_unref(src);
+    }
+};
+
+// Pipeline guard: switch the FPU to flush subnormal results (and
+// inputs, where supported) to zero for the duration of the processing,
+// and return the previous control word for cha_fpu_restore.
+
+FUNC(unsigned int) 
+cha_fpu_guard(void)
+{
+    unsigned int c;
+
+    c = fpu_get();
+    fpu_set(c | FPU_FTZ);
+    return (c);
+};
+
+FUNC(void) 
+cha_fpu_restore(unsigned int c)
+{
+    fpu_set(c);
 };
 
+// are the n bytes at p all zero?
+static int
+is_zero(void *p, int n)
+{
+    unsigned char *c = (unsigned char *) p;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (c[i]) return (0);
+    }
+    return (1);
+}
+
+// allocate the arrays that have a size but no data (the zero-filled
+// state left out of a generated header or image)
+static int
+data_alloc(CHA_PTR cp)
+{
+    int i, *cpsiz;
+
+    cpsiz = (int *) cp[_size];
+    for (i = 0; i < NPTR; i++) {
+        if ((i == _arena) || cp[i] || (cpsiz[i] <= 0)) continue;
+        if (cha_allocate(cp, cpsiz[i], 1, i) == NULL) {
+            return (1);
+        }
+    }
+    return (0);
+}
+
 FUNC(int)
 cha_data_gen(CHA_PTR cp, char *fn)
 {
-    int ptsiz, arsiz, arlen, i, j, *cpsiz;
-    unsigned long *ulptr;
+    char zf[NPTR];
+    int ptsiz, arsiz, arlen, i, j, nro, nst, nzf, *cpsiz;
+    CHA_DATA *ulptr;
     FILE *fp;
     static char *head[] = {
         "#ifndef CHA_DATA_H",
@@ -68,7 +535,7 @@ cha_data_gen(CHA_PTR cp, char *fn)
     };
     static int hdsz = sizeof(head) / sizeof(char *);
     static int tlsz = sizeof(tail) / sizeof(char *);
-    static int ptpl = 16;
+    static int ptpl = 8;
     static int arpl = 8;
     static int ivpl = 8;
     static int dvpl = 5;
@@ -85,35 +552,52 @@ cha_data_gen(CHA_PTR cp, char *fn)
     // print header
     arsiz = 0;
     for (i = 0; i < NPTR; i++) {
-        arsiz += cpsiz[i];
+        if (i != _arena) arsiz += cpsiz[i];
     }
     if (arsiz == 0) {
         fclose(fp);
         return (3);
     }
+    // zero-filled arrays (the state) are left to cha_data_init and
+    // the other arrays, except the variables, are const (flash)
+    nro = nst = nzf = 0;
+    for (i = 0; i < NPTR; i++) {
+        zf[i] = (i >= _reserve) && (i != _arena) && (cpsiz[i] > 0)
+            && ((cp[i] == NULL) || is_zero(cp[i], cpsiz[i]));
+        if ((i == _arena) || (cpsiz[i] <= 0)) continue;
+        if (zf[i]) {
+            nzf += cpsiz[i];
+        } else if ((i < _reserve) || (cpsiz[i] % sizeof(CHA_DATA))) {
+            nst += cpsiz[i];
+        } else {
+            nro += cpsiz[i];
+        }
+    }
     fprintf(fp, "// cha_data.h - array size = %d bytes\n", arsiz);
+    fprintf(fp, "// const (flash) = %d bytes, static (RAM) = %d bytes,"
+        " cha_data_init (RAM) = %d bytes\n", nro, nst, nzf);
     for (i = 0; i < hdsz; i++) {
         fprintf(fp, "%s\n", head[i]);
     }
     // initialize ptr arrays
     ptsiz = 0;
     for (i = 0; i < NPTR; i++) {
-        if (cp[i]) ptsiz = i + 1;
+        if ((cp[i] || (cpsiz[i] > 0)) && (i != _arena)) ptsiz = i + 1;
     }
     for (i = 0; i < ptsiz; i++) {
         if (i == _size) {
-            arlen = cpsiz[i] / sizeof(long);
+            arlen = cpsiz[i] / sizeof(CHA_DATA);
             arsiz = 0;
-            ulptr = (unsigned long *) cp[i];
+            ulptr = (CHA_DATA *) cp[i];
             if (ulptr) {
-                for (j = 0; j < arlen; j++) {
+                for (j = 0; (j < arlen) && (j != _arena); j++) {
                     if (ulptr[j]) arsiz = j + 1;
                 }
             }
             fprintf(fp, "static CHA_DATA p%02d[%8d] = { // _size\n", i, arlen);
             for (j = 0; j < arsiz; j++) {
                 if ((j % arpl) == 0) fprintf(fp, "        ");
-                fprintf(fp, "%10lu", ulptr[j]);
+                fprintf(fp, "%10lu", (unsigned long) ulptr[j]);
                 if (j < (arsiz - 1)) fprintf(fp, ",");
                 if ((j % arpl) == (arpl - 1)) fprintf(fp, "\n");
             }
@@ -151,23 +635,26 @@ cha_data_gen(CHA_PTR cp, char *fn)
             fprintf(fp, "};\n");
         } else if (cpsiz[i] == 0) {
             fprintf(fp, "// empty array ->     p%02d\n", i);
-        } else if ((cpsiz[i] % sizeof(long)) == 0) {
-            arlen = cpsiz[i] / sizeof(long);
+        } else if (zf[i]) {
+            fprintf(fp, "// zero-filled, allocated by cha_data_init -> p%02d[%8d bytes]\n",
+                i, cpsiz[i]);
+        } else if ((cpsiz[i] % sizeof(CHA_DATA)) == 0) {
+            arlen = cpsiz[i] / sizeof(CHA_DATA);
             arsiz = 0;
-            ulptr = (unsigned long *) cp[i];
+            ulptr = (CHA_DATA *) cp[i];
             if (ulptr) {
                 for (j = 0; j < arlen; j++) {
                     if (ulptr[j]) arsiz = j + 1;
                 }
             }
             if (arsiz < 2) {
-                fprintf(fp, "static CHA_DATA p%02d[%8d] = {%10lu};\n",
-                    i, arlen, ulptr[0]);
+                fprintf(fp, "static const CHA_DATA p%02d[%8d] = {%10lu};\n",
+                    i, arlen, (unsigned long) ulptr[0]);
             } else {
-                fprintf(fp, "static CHA_DATA p%02d[%8d] = {\n", i, arlen);
+                fprintf(fp, "static const CHA_DATA p%02d[%8d] = {\n", i, arlen);
                 for (j = 0; j < arsiz; j++) {
                     if ((j % arpl) == 0) fprintf(fp, "        ");
-                    fprintf(fp, "0x%08lX", ulptr[j]);
+                    fprintf(fp, "0x%08lX", (unsigned long) ulptr[j]);
                     if (j < (arsiz - 1)) fprintf(fp, ",");
                     if ((j % arpl) == (arpl - 1)) fprintf(fp, "\n");
                 }
@@ -195,11 +682,14 @@ cha_data_gen(CHA_PTR cp, char *fn)
             fprintf(fp, "(CHA_DATA *)p%02d,", i);
         }
         fprintf(fp, "\n");
+        j = 0;
         for (i = _reserve; i < ptsiz; i++) {
             j = i - _reserve;
             if ((j % ptpl) == 0) fprintf(fp, "    ");
-            if (cpsiz[i] == 0) {
+            if ((cpsiz[i] == 0) || zf[i]) {
                 fprintf(fp, "NULL");
+            } else if ((cpsiz[i] % sizeof(CHA_DATA)) == 0) {
+                fprintf(fp, "(CHA_DATA *)p%02d", i);
             } else {
                 fprintf(fp, " p%02d", i);
             }
@@ -217,3 +707,254 @@ cha_data_gen(CHA_PTR cp, char *fn)
 
     return (0);
 };
+
+/***********************************************************/
+
+// make a pipeline from a generated header ready for setup: allocate
+// the zero-filled arrays that cha_data_gen left out (those with a
+// size but no array) and record the arrays of the header as borrowed,
+// so that the const ones stay in flash (see cha_writable) and none is
+// ever freed
+FUNC(int)
+cha_data_init(CHA_PTR cp)
+{
+    int i, *cpsiz;
+    CHA_ARENA *ar;
+
+    cpsiz = (int *) cp[_size];
+    if (cpsiz == NULL) {
+        return (1);
+    }
+    if (cp[_arena]) {
+        return (0);         // done before
+    }
+    ar = arena_new(NULL, 0);
+    if (ar == NULL) {
+        return (1);
+    }
+    for (i = 0; i < NPTR; i++) {
+        ar->bw[i] = (i != _arena) && (cp[i] != NULL);
+    }
+    arena_set(cp, ar);
+
+    return (data_alloc(cp));
+};
+
+/***********************************************************/
+
+// Binary prescription image, written by cha_data_save and used in
+// place by cha_data_load (mapped file) or cha_data_image (any memory,
+// e.g. flash).  All fields are 32-bit words in the byte order of the
+// writer, which the order tag identifies; the loader refuses an image
+// of the other byte order rather than swap it.
+//
+//   word 0     magic "CHAB"
+//   word 1     version (CHA_BIN_VER)
+//   word 2     order tag 0x01020304
+//   word 3     number of pointer slots (NPTR)
+//   word 4     image length (bytes)
+//   word 5-7   reserved (0)
+//   then       byte offset & size of each pointer slot
+//   then       the arrays, each at a multiple of CHA_ALIGN bytes
+//
+// A slot of size 0 is empty.  A zero-filled array (the state) is not
+// stored: its offset is 0 and the loader allocates it.  The other
+// arrays are used where they lie, read-only, so the image must stay
+// in place, aligned to CHA_ALIGN, for as long as the pipeline is used;
+// only the variables (_size, _ivar & _dvar) are copied.  Like the
+// headers of cha_data_gen, an image is written before setup: plans,
+// tables & instances built by the setup functions are not portable.
+
+#define CHA_BIN_MAGIC   0x42414843      // "CHAB" read as a little-endian word
+#define CHA_BIN_VER     1
+#define CHA_BIN_ORDER   0x01020304
+#define CHA_BIN_HEAD    8               // header words before the slot table
+
+// byte offset of the first array
+static __inline size_t
+bin_data_offset(void)
+{
+    return (align_up((CHA_BIN_HEAD + 2 * NPTR) * sizeof(CHA_DATA)));
+}
+
+FUNC(int)
+cha_data_save(CHA_PTR cp, char *fn)
+{
+    char pad[CHA_ALIGN];
+    int i, *cpsiz;
+    size_t nb, off;
+    CHA_DATA hd[CHA_BIN_HEAD + 2 * NPTR];
+    FILE *fp;
+
+    cpsiz = (int *) cp[_size];
+    if (cpsiz == NULL) {
+        return (2);
+    }
+    // layout: stored arrays in index order
+    memset(hd, 0, sizeof(hd));
+    nb = bin_data_offset();
+    for (i = 0; i < NPTR; i++) {
+        if ((i == _arena) || (cpsiz[i] <= 0)) continue;
+        hd[CHA_BIN_HEAD + 2 * i + 1] = (CHA_DATA) cpsiz[i];
+        if ((i >= _reserve) && ((cp[i] == NULL) || is_zero(cp[i], cpsiz[i]))) continue;
+        hd[CHA_BIN_HEAD + 2 * i] = (CHA_DATA) nb;
+        nb += align_up(cpsiz[i]);
+    }
+    hd[0] = CHA_BIN_MAGIC;
+    hd[1] = CHA_BIN_VER;
+    hd[2] = CHA_BIN_ORDER;
+    hd[3] = NPTR;
+    hd[4] = (CHA_DATA) nb;
+    fp = fopen(fn, "wb");
+    if (fp == NULL) {
+        return (1);
+    }
+    memset(pad, 0, sizeof(pad));
+    fwrite(hd, sizeof(hd), 1, fp);
+    off = sizeof(hd);
+    for (i = 0; i < NPTR; i++) {
+        if (hd[CHA_BIN_HEAD + 2 * i] == 0) continue;
+        fwrite(pad, 1, hd[CHA_BIN_HEAD + 2 * i] - off, fp);
+        fwrite(cp[i], 1, cpsiz[i], fp);
+        off = hd[CHA_BIN_HEAD + 2 * i] + cpsiz[i];
+    }
+    fwrite(pad, 1, nb - off, fp);
+    i = ferror(fp);
+    if (fclose(fp) || i) {
+        return (1);
+    }
+
+    return (0);
+};
+
+// set up an empty pipeline from an image of nb bytes at img, which
+// stays the caller's: the arrays point into the image, the variables
+// are copied & the state is allocated
+FUNC(int)
+cha_data_image(CHA_PTR cp, void *img, int nb)
+{
+    void *var[_reserve];
+    int i;
+    CHA_DATA *hd = (CHA_DATA *) img, off, siz;
+    CHA_ARENA *ar;
+
+    if ((nb < (int) bin_data_offset()) || ((size_t) img % CHA_ALIGN)) {
+        return (1);
+    }
+    if ((hd[0] != CHA_BIN_MAGIC) || (hd[1] != CHA_BIN_VER)
+        || (hd[2] != CHA_BIN_ORDER) || (hd[3] != NPTR) || (hd[4] > (CHA_DATA) nb)) {
+        return (1);
+    }
+    for (i = 0; i < NPTR; i++) {
+        off = hd[CHA_BIN_HEAD + 2 * i];
+        siz = hd[CHA_BIN_HEAD + 2 * i + 1];
+        if ((siz == 0) || (off == 0)) continue;
+        if ((off % CHA_ALIGN) || (off > hd[4]) || (siz > hd[4] - off)) {
+            return (1);
+        }
+    }
+    if ((hd[CHA_BIN_HEAD + 2 * _size + 1] != NPTR * sizeof(int))
+        || (hd[CHA_BIN_HEAD + 2 * _ivar + 1] != NVAR * sizeof(int))
+        || (hd[CHA_BIN_HEAD + 2 * _dvar + 1] != NVAR * sizeof(double))) {
+        return (1);
+    }
+    for (i = 0; i < _reserve; i++) {
+        if (hd[CHA_BIN_HEAD + 2 * i] == 0) {
+            return (1);
+        }
+    }
+    // the variables are changed by setup, so they are copied
+    ar = arena_new(NULL, 0);
+    for (i = 0; i < _reserve; i++) {
+        var[i] = malloc(hd[CHA_BIN_HEAD + 2 * i + 1]);
+    }
+    if ((ar == NULL) || !var[_size] || !var[_ivar] || !var[_dvar]) {
+        for (i = 0; i < _reserve; i++) {
+            if (var[i]) free(var[i]);
+        }
+        if (ar) free(ar);
+        return (1);
+    }
+    for (i = 0; i < NPTR; i++) {
+        off = hd[CHA_BIN_HEAD + 2 * i];
+        siz = hd[CHA_BIN_HEAD + 2 * i + 1];
+        cp[i] = (siz && off) ? (char *) img + off : NULL;
+        if (i < _reserve) {
+            cp[i] = memcpy(var[i], cp[i], siz);
+        }
+    }
+    ar->img = (char *) img;
+    ar->ni = hd[4];
+    ar->kind = IMAGE_CALLER;
+    arena_set(cp, ar);
+
+    return (data_alloc(cp));
+};
+
+// set up an empty pipeline from an image file: mapped read-only
+// where the system has mmap, so that pipelines loading the same file
+// share its pages, otherwise read into the heap; either is released
+// by cha_cleanup
+FUNC(int)
+cha_data_load(CHA_PTR cp, char *fn)
+{
+    void *map;
+    size_t len;
+    CHA_ARENA *ar;
+  #ifdef HAVE_MMAP
+    int fd;
+    struct stat st;
+
+    fd = open(fn, O_RDONLY);
+    if (fd < 0) {
+        return (1);
+    }
+    if ((fstat(fd, &st) < 0) || (st.st_size <= 0) || (st.st_size > 0x7FFFFFFF)) {
+        close(fd);
+        return (1);
+    }
+    len = st.st_size;
+    map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return (1);
+    }
+    if (cha_data_image(cp, map, (int) len)) {
+        cha_cleanup(cp);
+        munmap(map, len);
+        return (1);
+    }
+    ar = (CHA_ARENA *) cp[_arena];
+    ar->kind = IMAGE_MAP;
+  #else
+    long n;
+    FILE *fp;
+
+    fp = fopen(fn, "rb");
+    if (fp == NULL) {
+        return (1);
+    }
+    fseek(fp, 0, SEEK_END);
+    n = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    len = (n > 0) ? n : 0;
+    map = len ? malloc(len + CHA_ALIGN - 1) : NULL;
+    if ((map == NULL) || (fread((void *) align_up(map), 1, len, fp) != len)) {
+        fclose(fp);
+        if (map) free(map);
+        return (1);
+    }
+    fclose(fp);
+    if (cha_data_image(cp, (void *) align_up(map), (int) len)) {
+        cha_cleanup(cp);
+        free(map);
+        return (1);
+    }
+    ar = (CHA_ARENA *) cp[_arena];
+    ar->kind = IMAGE_HEAP;
+  #endif
+    ar->map = map;
+    ar->len = len;
+
+    return (0);
+};
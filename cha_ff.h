@@ -32,21 +32,113 @@ typedef struct {
     double bolt;                 // broadband output limiting threshold
 } CHA_WDRC;
 
+// preset bank
+
+#define CHA_MXPRE 8              // maximum number of presets
+
+typedef struct {
+    CHA_PTR cp[CHA_MXPRE];       // resident prescriptions
+    int np;                      // number of presets
+    int cs;                      // chunk size
+    int nf;                      // crossfade length (samples)
+    int cur;                     // active preset
+    int nxt;                     // preset fading in, -1 = none
+    int jf;                      // crossfade position (samples), -1 = warm-up
+    volatile int req;            // preset requested by cha_bank_select
+    float *xb;                   // input copy for the incoming preset
+    float *fw;                   // fade-in weights, sin(pi/2*j/nf), j=0..nf
+} CHA_BANK;
+
+// pipeline context: the sizes & arrays used per block, read once from
+// the pointer table by cha_context, so that the processing loops work
+// on typed, non-aliasing arrays instead of void * lookups.  The arrays
+// still belong to the CHA_PTR.  A context is stale once an array is
+// reallocated or swapped (setup, cha_param_sync), so build it at the
+// start of each block; the CHA_PTR entry points do that per call.
+
+typedef struct {
+    CHA_PTR cp;                  // prescription (for compressors not set up)
+    int cs;                      // chunk size
+    int nw;                      // window size
+    int nc;                      // number of channels
+    int ngs;                     // gain interval (samples)
+    void *pl;                    // FFT plan
+    void *ai;                    // ARM Math FFT instance, NULL = rfft.c
+    void *gcpar;                 // WDRC records, NULL = derive from cp
+    float *CHA_RESTRICT hh;      // channel responses
+    float *CHA_RESTRICT xx;      // input spectrum
+    float *CHA_RESTRICT yy;      // channel spectrum
+    float *CHA_RESTRICT zz;      // channel overlap
+    float *CHA_RESTRICT fd;      // frequency-domain delay line
+    float *CHA_RESTRICT wk;      // ARM Math workspace
+    float *CHA_RESTRICT ch;      // channel buffer of cha_firfb_process
+    float *CHA_RESTRICT xpk;     // envelope
+    float *CHA_RESTRICT ppk;     // input & output envelope state
+    float *CHA_RESTRICT gcppk;   // channel envelope state
+    float *CHA_RESTRICT gcxpk;   // interleaved channel envelopes
+    float *CHA_RESTRICT gcgn;    // control-rate gains
+    float *CHA_RESTRICT gctab;   // gain tables
+} CHA_CTX;
+
 /*****************************************************/
 
 // firfb module
 
 FUNC(int) cha_firfb_prepare(CHA_PTR, double *, int, double, 
                             int, int, int);
+FUNC(int) cha_firfb_setup(CHA_PTR);
+FUNC(int) cha_firfb_share(CHA_PTR, CHA_PTR);
 FUNC(void) cha_firfb_analyze(CHA_PTR, float *, float *, int);
 FUNC(void) cha_firfb_synthesize(CHA_PTR, float *, float *, int);
+FUNC(void) cha_firfb_process(CHA_PTR, float *, float *, int);
+FUNC(int) cha_firfb_param(CHA_PTR, float *);
+FUNC(int) cha_firfb_half(CHA_PTR, double);
+FUNC(void) cha_context(CHA_PTR, CHA_CTX *);
+FUNC(void) cha_firfb_analyze_cx(CHA_CTX *, float *, float *, int);
+FUNC(void) cha_firfb_synthesize_cx(CHA_CTX *, float *, float *, int);
+FUNC(void) cha_firfb_process_cx(CHA_CTX *, float *, float *, int);
 
 // compressor module
 
 FUNC(int) cha_agc_prepare(CHA_PTR, CHA_DSL *, CHA_WDRC *);
+FUNC(int) cha_agc_setup(CHA_PTR);
 FUNC(void) cha_agc_input(CHA_PTR, float *, float *, int);
 FUNC(void) cha_agc_channel(CHA_PTR, float *, float *, int);
+FUNC(void) cha_agc_chan(CHA_PTR, float *, float *, int, int);
 FUNC(void) cha_agc_output(CHA_PTR, float *, float *, int);
+FUNC(int) cha_agc_param(CHA_PTR, int, float, float, float, float);
+FUNC(void) cha_agc_input_cx(CHA_CTX *, float *, float *, int);
+FUNC(void) cha_agc_channel_cx(CHA_CTX *, float *, float *, int);
+FUNC(void) cha_agc_chan_cx(CHA_CTX *, float *, float *, int, int);
+FUNC(void) cha_agc_output_cx(CHA_CTX *, float *, float *, int);
+
+// fixed-point pipeline (CHA_QS samples, see cha_fix.h)
+
+FUNC(int) cha_firfb_setup_q(CHA_PTR);
+FUNC(void) cha_firfb_process_q(CHA_PTR, int *, int *, int);
+FUNC(int) cha_agc_setup_q(CHA_PTR);
+FUNC(void) cha_agc_input_q(CHA_PTR, int *, int *, int);
+FUNC(void) cha_agc_chan_q(CHA_PTR, int *, int *, int, int);
+FUNC(void) cha_agc_output_q(CHA_PTR, int *, int *, int);
+
+// limiter module
+
+FUNC(int) cha_limit_setup(CHA_PTR, double, double);
+FUNC(void) cha_limit_process(CHA_PTR, float *, float *, int);
+
+// parameter updates
+
+FUNC(int) cha_param_setup(CHA_PTR);
+FUNC(int) cha_param_begin(CHA_PTR);
+FUNC(int) cha_param_commit(CHA_PTR);
+FUNC(int) cha_param_sync(CHA_PTR);
+
+// preset bank
+
+FUNC(int) cha_bank_setup(CHA_BANK *, CHA_PTR *, int, int);
+FUNC(int) cha_bank_select(CHA_BANK *, int);
+FUNC(void) cha_bank_process(CHA_BANK *, float *, float *, int);
+FUNC(void) cha_bank_cleanup(CHA_BANK *);
 
 /*****************************************************/
 
@@ -66,12 +158,47 @@ FUNC(void) cha_agc_output(CHA_PTR, float *, float *, int);
 #define _gcppk    _offset+9
 #define _xpk      _offset+10
 #define _ppk      _offset+11
+#define _ffpl     _offset+12
+#define _fffd     _offset+13
+#define _ffai     _offset+14
+#define _ffwk     _offset+15
+#define _ffch     _offset+16
+#define _gcxpk    _offset+17
+#define _gcgn     _offset+18
+#define _gctab    _offset+19
+#define _gcpar    _offset+20
+#define _ffhhs    _offset+21
+#define _gcpars   _offset+22
+#define _gctabs   _offset+23
+#define _pmbx     _offset+24
+#define _lmst     _offset+25
+#define _lmbuf    _offset+26
+#define _lmqt     _offset+27
+#define _ffpq     _offset+28
+#define _ffhq     _offset+29
+#define _ffeq     _offset+30
+#define _ffzq     _offset+31
+#define _ffwq     _offset+32
+#define _gcqpar   _offset+33
+#define _gcqtab   _offset+34
+#define _gcqxpk   _offset+35
+#define _ffh16    _offset+36
+#define _gcqst    _offset+37
+
+// pointer indices of the per-block state (overlap buffers, envelopes,
+// gains, workspace), which cha_arena_pack places together ahead of
+// the coefficients, e.g. static int hot[] = {CHA_FF_STATE};
+#define CHA_FF_STATE \
+    _ffxx, _ffyy, _ffzz, _fffd, _ffwk, _ffch, _xpk, _ppk, _gcppk, \
+    _gcxpk, _gcgn, _lmst, _lmbuf, _lmqt, _pmbx, _ffzq, _ffwq, _gcqxpk, \
+    _gcqst
 
 // integer variable indices
 
 #define _cs       0 
 #define _nw       1
 #define _nc       2
+#define _ngs      3     // gain interval (samples) of the channel compressors, 0 or 1 = every sample
 
 // double variable indices
 
@@ -1,4 +1,5 @@
 // cha_data.h - array size = 18424 bytes
+// const (flash) = 8576 bytes, static (RAM) = 448 bytes, cha_data_init (RAM) = 9400 bytes
 #ifndef CHA_DATA_H
 #define CHA_DATA_H
 
@@ -13,8 +14,8 @@ static double   p02[      16] = { // _dvar
             0.908230841,    0.998517215,          24000,            119,              0,
                     105,             10,            105,    0.980191946,    0.998517215
 };
-static CHA_DATA p03[     512] = {         0};
-static CHA_DATA p04[    2112] = {
+// zero-filled, allocated by cha_data_init -> p03[    2048 bytes]
+static const CHA_DATA p04[    2112] = {
         0x3CF51242,0x00000000,0xBCE91D16,0xBC6D2130,0x3C37410A,0x3CB9ACC6,0xBB6C2739,0xBC7B5C6C,
         0x3A082324,0x3C575A08,0x396C08D8,0xBC19AD99,0xBAA6459F,0x3C0FEC75,0x3AA609B0,0xBBD8F674,
         0xBAF69FCE,0x3BD41A0A,0x3ADDF45B,0xBBA4B008,0xBB0DBD13,0x3BA4D1B8,0x3AFA24B2,0xBB822C3E,
@@ -280,28 +281,29 @@ static CHA_DATA p04[    2112] = {
         0x3ABF40D4,0xBAC6780B,0x3B092252,0xBAB8B608,0x3AC900D5,0xBA850E86,0x3B0B9156,0xBA6A39D8,
         0x3ACEE4B0,0xBA1986AE,0x3B0CEF5E,0xB9E3A930,0x3AD1AC2A,0xB948E3F0,0x3B0D6043
 };
-static CHA_DATA p05[     258] = {         0};
-static CHA_DATA p06[     258] = {         0};
-static CHA_DATA p07[    1280] = {         0};
-static CHA_DATA p08[       8] = {
+// zero-filled, allocated by cha_data_init -> p05[    1032 bytes]
+// zero-filled, allocated by cha_data_init -> p06[    1032 bytes]
+// zero-filled, allocated by cha_data_init -> p07[    5120 bytes]
+static const CHA_DATA p08[       8] = {
         0x4200CCCD,0x41D40000,0x41D5999A,0x41D5999A,0x41EE6666,0x42066666,0x42093333,0x4202CCCD
 };
-static CHA_DATA p09[       8] = {
+static const CHA_DATA p09[       8] = {
         0x3F333333,0x3F666666,0x3F800000,0x3F8CCCCD,0x3F99999A,0x3FB33333,0x3FCCCCCD,0x3FD9999A
 };
-static CHA_DATA p10[       8] = {
+static const CHA_DATA p10[       8] = {
         0xC15981D8,0xC184BA2A,0xC0730F28,0x40D3C361,0x4134E148,0x41BDBF14,0x420F6F35,0x42158DD3
 };
-static CHA_DATA p11[       8] = {
+static const CHA_DATA p11[       8] = {
         0x42825852,0x428F37DC,0x42ADCDED,0x42B9AAA6,0x42C46666,0x42CE999A,0x42CBCCCD,0x42C7999A
 };
-static CHA_DATA p12[       8] = {         0};
-static CHA_DATA p13[      32] = {         0};
-static CHA_DATA p14[       2] = {         0};
+// zero-filled, allocated by cha_data_init -> p12[      32 bytes]
+// zero-filled, allocated by cha_data_init -> p13[     128 bytes]
+// zero-filled, allocated by cha_data_init -> p14[       8 bytes]
 
 static CHA_DATA *cha_data[NPTR] = {
     (CHA_DATA *)p00,(CHA_DATA *)p01,(CHA_DATA *)p02,
-     p03, p04, p05, p06, p07, p08, p09, p10, p11, p12, p13, p14
+    NULL,(CHA_DATA *)p04,NULL,NULL,NULL,(CHA_DATA *)p08,(CHA_DATA *)p09,(CHA_DATA *)p10,
+    (CHA_DATA *)p11,NULL,NULL,NULL
 };
 
 #endif // CHA_DATA_H
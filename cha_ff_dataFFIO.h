@@ -1,4 +1,5 @@
 // cha_data.h - array size = 37456 bytes
+// const (flash) = 16512 bytes, static (RAM) = 448 bytes, cha_data_init (RAM) = 20496 bytes
 #ifndef CHA_DATA_H
 #define CHA_DATA_H
 
@@ -11,8 +12,8 @@ static CHA_DATA p01[      16] = { // _ivar
 static double   p02[      16] = { // _dvar
                       0,              0,          24000
 };
-static CHA_DATA p03[    1024] = {         0};
-static CHA_DATA p04[    4128] = {
+// zero-filled, allocated by cha_data_init -> p03[    4096 bytes]
+static const CHA_DATA p04[    4128] = {
         0x3EF9DA3C,0x00000000,0xBEF99A31,0xBDD9EB08,0x3EF234DF,0x3E86ABD7,0xBE9BDF9E,0xBEE01B7A,
         0x3D74D988,0x3ECD320B,0x3C5EE0D3,0xBE863F22,0xBC523724,0x3E4A6F09,0x3C4B539E,0xBE250273,
         0xBC54C328,0x3E0E367A,0x3C4B9B6A,0xBDF5D551,0xBC53F92A,0x3DDD4632,0x3C4C6720,0xBDC4FE44,
@@ -530,13 +531,13 @@ static CHA_DATA p04[    4128] = {
         0x3F4A4929,0x3CAE53B8,0x3F4A36DB,0x3C956AAA,0x3F4A4922,0x3C788E44,0x3F4A36DE,0x3C46E688,
         0x3F4A491E,0x3C14F0FC,0x3F4A36E3,0x3BC6B552,0x3F4A491D,0x3B4675FA,0x3F4A36E4
 };
-static CHA_DATA p05[     514] = {         0};
-static CHA_DATA p06[     514] = {         0};
-static CHA_DATA p07[    3072] = {         0};
+// zero-filled, allocated by cha_data_init -> p05[    2056 bytes]
+// zero-filled, allocated by cha_data_init -> p06[    2056 bytes]
+// zero-filled, allocated by cha_data_init -> p07[   12288 bytes]
 
 static CHA_DATA *cha_data[NPTR] = {
     (CHA_DATA *)p00,(CHA_DATA *)p01,(CHA_DATA *)p02,
-     p03, p04, p05, p06, p07
+    NULL,(CHA_DATA *)p04,NULL,NULL,NULL
 };
 
 #endif // CHA_DATA_H
@@ -0,0 +1,56 @@
+// cha_fix.h - fixed-point formats & helpers
+#ifndef CHA_FIX_H
+#define CHA_FIX_H
+
+/*****************************************************/
+
+// The fixed-point pipeline keeps audio samples and envelopes in Q27
+// (CHA_QS fraction bits, so 16 = +24 dB of headroom above full scale
+// between the stages), filter coefficients & smoothing constants in
+// Q31 and linear gains in Q23 (CHA_QG, gains up to +48 dB).  Spectra
+// are block floating point: an int array with one exponent, the value
+// being q * 2^e.  Products are formed in 64 bits and shifted back.
+
+#define CHA_QS      27              // sample & envelope fraction bits
+#define CHA_QG      23              // gain fraction bits
+#define CHA_Q31     2147483647.0    // scale of Q31 constants
+
+typedef long long cha_i64;
+
+// count leading zeros of a nonzero word
+#if defined(__GNUC__)
+#define cha_clz(u)  __builtin_clz(u)
+#else
+static __inline int
+cha_clz(unsigned int u)
+{
+    int n = 0;
+
+    while (!(u & 0x80000000u)) {
+        u <<= 1;
+        n++;
+    }
+    return (n);
+}
+#endif
+
+// saturate a 64-bit value to 32 bits
+static __inline int
+cha_sat32(cha_i64 v)
+{
+    return ((v > 2147483647LL) ? 2147483647 : (v < -2147483647LL) ? -2147483647 : (int) v);
+}
+
+// Q31 product
+#define cha_mulq31(a,b)     ((int) (((cha_i64) (a) * (b)) >> 31))
+
+// Q31 constant from a double in [-1,1]
+static __inline int
+cha_q31(double d)
+{
+    d *= CHA_Q31;
+    return ((d >= CHA_Q31) ? 2147483647 : (d <= -CHA_Q31) ? -2147483647 :
+        (int) ((d < 0) ? d - 0.5 : d + 0.5));
+}
+
+#endif /* CHA_FIX_H */
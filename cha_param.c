@@ -0,0 +1,168 @@
+// cha_param.c - double-buffered parameter updates
+
+#include <stdlib.h>
+#include <string.h>
+#include "chapro.h"
+#include "cha_ff.h"
+
+// The parameters used per block (filterbank responses, WDRC records
+// and gain tables) have a second, staging copy.  A fitting program
+// changes the staging copy off the audio thread (cha_param_begin,
+// cha_agc_param, cha_firfb_param) and publishes it with
+// cha_param_commit.  The audio thread calls cha_param_sync at a block
+// boundary, which swaps the active and staging pointers when a new set
+// is pending.  The two threads only meet at one atomic int (_pmbx), so
+// the audio path never waits, locks or allocates.  Only one thread may
+// make changes.  The staging copy is made by the first cha_param_begin,
+// so a pipeline that is never changed keeps one copy, and the active
+// arrays may stay borrowed (const responses of a generated header, or
+// the prescription of cha_instance) until then.
+
+// mailbox states
+#define PM_IDLE     0   // staging copy belongs to the writer
+#define PM_PEND     1   // staging copy published, not yet taken
+#define PM_SWAP     2   // audio thread is swapping
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define mbx_cas(p,o,n)  (_InterlockedCompareExchange((long volatile *)(p),n,o) == (o))
+#define mbx_load(p)     _InterlockedOr((long volatile *)(p), 0)
+#define mbx_store(p,v)  _InterlockedExchange((long volatile *)(p), v)
+#else
+#define mbx_cas(p,o,n)  mbx_cas_gcc(p,o,n)
+#define mbx_load(p)     __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define mbx_store(p,v)  __atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+static __inline int
+mbx_cas_gcc(int *p, int o, int n)
+{
+    return (__atomic_compare_exchange_n(p, &o, n, 0,
+        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+}
+#endif
+
+// active & staging pointer indices
+static int pm_slot[][2] = {
+    {_ffhh,  _ffhhs},
+    {_gcpar, _gcpars},
+    {_gctab, _gctabs}
+};
+static int pm_nslot = sizeof(pm_slot) / sizeof(pm_slot[0]);
+
+/***********************************************************/
+
+// make the staging copy an array that cp owns (writer thread, while
+// the audio thread leaves it alone), refreshed from the active one
+// when fresh is set or when it had to be allocated
+static int
+pm_stage(CHA_PTR cp, int fresh)
+{
+    int i, a, s, *cpsiz;
+
+    cpsiz = (int *) cp[_size];
+    for (i = 0; i < pm_nslot; i++) {
+        a = pm_slot[i][0];
+        s = pm_slot[i][1];
+        if ((cp[s] == NULL) || (cpsiz[s] != cpsiz[a])) {
+            if (cha_allocate(cp, cpsiz[a], 1, s) == NULL) {
+                return (1);
+            }
+            memcpy(cp[s], cp[a], cpsiz[a]);
+            continue;
+        }
+        if (cha_writable(cp, s) == NULL) {
+            return (1);
+        }
+        if (fresh) {
+            memcpy(cp[s], cp[a], cpsiz[a]);
+        }
+    }
+
+    return (0);
+}
+
+// allocate the mailbox; call after cha_firfb_setup and cha_agc_setup.
+// The staging copies are left to the first cha_param_begin.
+FUNC(int)
+cha_param_setup(CHA_PTR cp)
+{
+    int i, a, *cpsiz;
+
+    cpsiz = (int *) cp[_size];
+    for (i = 0; i < pm_nslot; i++) {
+        a = pm_slot[i][0];
+        if ((cp[a] == NULL) || (cpsiz[a] <= 0)) {
+            return (1);
+        }
+    }
+    if (cha_allocate(cp, 1, sizeof(int), _pmbx) == NULL) {
+        return (1);
+    }
+
+    return (0);
+}
+
+// start changing the staging copy (writer thread): an unclaimed
+// publication is taken back, otherwise the staging copy is refreshed
+// from the active parameters.  A staging copy that cp does not own
+// yet (none, or one borrowed from a shared prescription) is allocated
+// here, so this call may allocate.
+FUNC(int)
+cha_param_begin(CHA_PTR cp)
+{
+    int *mbx;
+
+    mbx = (int *) cp[_pmbx];
+    if (mbx == NULL) {
+        return (1);
+    }
+    if (mbx_cas(mbx, PM_PEND, PM_IDLE)) {
+        return (pm_stage(cp, 0));   // still staged, keep changing it
+    }
+    while (mbx_load(mbx) == PM_SWAP) {
+        ;                           // audio thread is swapping
+    }
+
+    return (pm_stage(cp, 1));
+}
+
+// publish the staging copy (writer thread); fails without a staging
+// copy of cp's own, i.e. without cha_param_begin
+FUNC(int)
+cha_param_commit(CHA_PTR cp)
+{
+    int i, s, *mbx;
+
+    mbx = (int *) cp[_pmbx];
+    if (mbx == NULL) {
+        return (1);
+    }
+    for (i = 0; i < pm_nslot; i++) {
+        s = pm_slot[i][1];
+        if ((cp[s] == NULL) || cha_borrowed(cp, s)) {
+            return (1);
+        }
+    }
+    mbx_store(mbx, PM_PEND);
+
+    return (0);
+}
+
+// adopt published parameters (audio thread, at a block boundary);
+// returns 1 when the parameters changed
+FUNC(int)
+cha_param_sync(CHA_PTR cp)
+{
+    int i, *mbx;
+
+    mbx = (int *) cp[_pmbx];
+    if ((mbx == NULL) || !mbx_cas(mbx, PM_PEND, PM_SWAP)) {
+        return (0);
+    }
+    for (i = 0; i < pm_nslot; i++) {
+        cha_swap(cp, pm_slot[i][0], pm_slot[i][1]);
+    }
+    mbx_store(mbx, PM_IDLE);
+
+    return (1);
+}
@@ -0,0 +1,138 @@
+// cha_simd.h - portable wrappers for SIMD instruction sets
+#ifndef CHA_SIMD_H
+#define CHA_SIMD_H
+
+/*****************************************************/
+
+// The instruction set is selected at build time from the compiler's
+// target flags. CHA_SIMD is the number of float lanes, and is left
+// undefined when no vector unit is available (e.g. Cortex-M4) or when
+// CHA_NO_SIMD is defined, so that the scalar reference code is used.
+// Comparisons return a lane mask (cha_vm) for the branchless select
+// vf_sel(m,a,b), which takes a where the mask is set and b elsewhere.
+// cha_vi holds 32-bit integer lanes for IEEE-754 bit manipulation;
+// vf_asvi/vi_asvf reinterpret the bits, vi_cvt/vf_cvt convert values
+// (truncating). vf_div is only defined where the vector unit divides.
+
+#if defined(CHA_NO_SIMD)
+
+#elif defined(__AVX2__)
+
+#include <immintrin.h>
+#define CHA_SIMD            8
+typedef __m256 cha_vf;
+#define vf_load(p)          _mm256_loadu_ps(p)
+#define vf_store(p,a)       _mm256_storeu_ps(p,a)
+#define vf_dup(x)           _mm256_set1_ps(x)
+#define vf_add(a,b)         _mm256_add_ps(a,b)
+#define vf_sub(a,b)         _mm256_sub_ps(a,b)
+#define vf_mul(a,b)         _mm256_mul_ps(a,b)
+typedef __m256 cha_vm;
+#define vf_ge(a,b)          _mm256_cmp_ps(a,b,_CMP_GE_OQ)
+#define vf_sel(m,a,b)       _mm256_blendv_ps(b,a,m)
+#define vf_abs(a)           _mm256_andnot_ps(_mm256_set1_ps(-0.0f),a)
+#define vf_min(a,b)         _mm256_min_ps(a,b)
+#define vf_max(a,b)         _mm256_max_ps(a,b)
+#define vf_div(a,b)         _mm256_div_ps(a,b)
+typedef __m256i cha_vi;
+#define vi_dup(i)           _mm256_set1_epi32(i)
+#define vi_add(a,b)         _mm256_add_epi32(a,b)
+#define vi_sub(a,b)         _mm256_sub_epi32(a,b)
+#define vi_sra(a,n)         _mm256_srai_epi32(a,n)
+#define vi_sll(a,n)         _mm256_slli_epi32(a,n)
+#define vf_asvi(a)          _mm256_castps_si256(a)
+#define vi_asvf(a)          _mm256_castsi256_ps(a)
+#define vi_cvt(a)           _mm256_cvtepi32_ps(a)
+#define vf_cvt(a)           _mm256_cvttps_epi32(a)
+
+#elif defined(__SSE2__) || defined(_M_X64)
+
+#include <emmintrin.h>
+#define CHA_SIMD            4
+typedef __m128 cha_vf;
+#define vf_load(p)          _mm_loadu_ps(p)
+#define vf_store(p,a)       _mm_storeu_ps(p,a)
+#define vf_dup(x)           _mm_set1_ps(x)
+#define vf_add(a,b)         _mm_add_ps(a,b)
+#define vf_sub(a,b)         _mm_sub_ps(a,b)
+#define vf_mul(a,b)         _mm_mul_ps(a,b)
+typedef __m128 cha_vm;
+#define vf_ge(a,b)          _mm_cmpge_ps(a,b)
+#define vf_sel(m,a,b)       _mm_or_ps(_mm_and_ps(m,a),_mm_andnot_ps(m,b))
+#define vf_abs(a)           _mm_andnot_ps(_mm_set1_ps(-0.0f),a)
+#define vf_min(a,b)         _mm_min_ps(a,b)
+#define vf_max(a,b)         _mm_max_ps(a,b)
+#define vf_div(a,b)         _mm_div_ps(a,b)
+typedef __m128i cha_vi;
+#define vi_dup(i)           _mm_set1_epi32(i)
+#define vi_add(a,b)         _mm_add_epi32(a,b)
+#define vi_sub(a,b)         _mm_sub_epi32(a,b)
+#define vi_sra(a,n)         _mm_srai_epi32(a,n)
+#define vi_sll(a,n)         _mm_slli_epi32(a,n)
+#define vf_asvi(a)          _mm_castps_si128(a)
+#define vi_asvf(a)          _mm_castsi128_ps(a)
+#define vi_cvt(a)           _mm_cvtepi32_ps(a)
+#define vf_cvt(a)           _mm_cvttps_epi32(a)
+
+#elif defined(__ARM_FEATURE_MVE) && (__ARM_FEATURE_MVE & 2)
+
+#include <arm_mve.h>        // Helium (M-profile vector extension)
+#define CHA_SIMD            4
+typedef float32x4_t cha_vf;
+#define vf_load(p)          vld1q_f32(p)
+#define vf_store(p,a)       vst1q_f32(p,a)
+#define vf_dup(x)           vdupq_n_f32(x)
+#define vf_add(a,b)         vaddq_f32(a,b)
+#define vf_sub(a,b)         vsubq_f32(a,b)
+#define vf_mul(a,b)         vmulq_f32(a,b)
+typedef mve_pred16_t cha_vm;
+#define vf_ge(a,b)          vcmpgeq_f32(a,b)
+#define vf_sel(m,a,b)       vpselq_f32(a,b,m)
+#define vf_abs(a)           vabsq_f32(a)
+#define vf_min(a,b)         vminnmq_f32(a,b)
+#define vf_max(a,b)         vmaxnmq_f32(a,b)
+typedef int32x4_t cha_vi;
+#define vi_dup(i)           vdupq_n_s32(i)
+#define vi_add(a,b)         vaddq_s32(a,b)
+#define vi_sub(a,b)         vsubq_s32(a,b)
+#define vi_sra(a,n)         vshrq_n_s32(a,n)
+#define vi_sll(a,n)         vshlq_n_s32(a,n)
+#define vf_asvi(a)          vreinterpretq_s32_f32(a)
+#define vi_asvf(a)          vreinterpretq_f32_s32(a)
+#define vi_cvt(a)           vcvtq_f32_s32(a)
+#define vf_cvt(a)           vcvtq_s32_f32(a)
+
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+#include <arm_neon.h>
+#define CHA_SIMD            4
+typedef float32x4_t cha_vf;
+#define vf_load(p)          vld1q_f32(p)
+#define vf_store(p,a)       vst1q_f32(p,a)
+#define vf_dup(x)           vdupq_n_f32(x)
+#define vf_add(a,b)         vaddq_f32(a,b)
+#define vf_sub(a,b)         vsubq_f32(a,b)
+#define vf_mul(a,b)         vmulq_f32(a,b)
+typedef uint32x4_t cha_vm;
+#define vf_ge(a,b)          vcgeq_f32(a,b)
+#define vf_sel(m,a,b)       vbslq_f32(m,a,b)
+#define vf_abs(a)           vabsq_f32(a)
+#define vf_min(a,b)         vminq_f32(a,b)
+#define vf_max(a,b)         vmaxq_f32(a,b)
+#if defined(__aarch64__)
+#define vf_div(a,b)         vdivq_f32(a,b)
+#endif
+typedef int32x4_t cha_vi;
+#define vi_dup(i)           vdupq_n_s32(i)
+#define vi_add(a,b)         vaddq_s32(a,b)
+#define vi_sub(a,b)         vsubq_s32(a,b)
+#define vi_sra(a,n)         vshrq_n_s32(a,n)
+#define vi_sll(a,n)         vshlq_n_s32(a,n)
+#define vf_asvi(a)          vreinterpretq_s32_f32(a)
+#define vi_asvf(a)          vreinterpretq_f32_s32(a)
+#define vi_cvt(a)           vcvtq_f32_s32(a)
+#define vf_cvt(a)           vcvtq_s32_f32(a)
+
+#endif
+
+#endif /* CHA_SIMD_H */
@@ -2,6 +2,8 @@
 #ifndef CHAPRO_H
 #define CHAPRO_H
 
+#include <stdint.h>
+
 #ifdef DLL
 #define FUNC(type) __declspec(dllexport) type _stdcall
 #else
@@ -29,6 +31,11 @@
 #define _hypot          hypot
 #define __inline        inline
 #endif
+#if defined(_MSC_VER)
+#define CHA_RESTRICT    __restrict
+#else
+#define CHA_RESTRICT    __restrict__
+#endif
 
 #define fmin(x,y)       ((x<y)?(x):(y))
 #define fmove(x,y,n)    memmove(x,y,(n)*sizeof(float))
@@ -37,8 +44,9 @@
 #define round(x)        ((int)floorf((x)+0.5))
 #define log2(x)         (logf(x)/M_LN2)
 
-typedef unsigned long CHA_DATA;
-typedef unsigned long *CHA_LPTR;
+// generated data are 32-bit words, whatever the width of long
+typedef uint32_t CHA_DATA;
+typedef uint32_t *CHA_LPTR;
 typedef void **CHA_PTR;
 
 /*****************************************************/
@@ -46,16 +54,39 @@ typedef void **CHA_PTR;
 // CHA common functions
 
 FUNC(void *) cha_allocate(CHA_PTR, int, int, int);
+FUNC(int)    cha_arena_pack(CHA_PTR, int *, int, CHA_PTR);
+FUNC(int)    cha_borrowed(CHA_PTR, int);
 FUNC(void)   cha_cleanup(CHA_PTR);
+FUNC(CHA_PTR) cha_copy(CHA_PTR);
 FUNC(int)    cha_data_gen(CHA_PTR, char *);
+FUNC(int)    cha_data_image(CHA_PTR, void *, int);
+FUNC(int)    cha_data_init(CHA_PTR);
+FUNC(int)    cha_data_load(CHA_PTR, char *);
+FUNC(int)    cha_data_save(CHA_PTR, char *);
 FUNC(float)  cha_db1(float);
+FUNC(void)   cha_db1_vec(const float *, float *, int);
 FUNC(float)  cha_db2(float);
+FUNC(void)   cha_db2_vec(const float *, float *, int);
+FUNC(int)    cha_db_method(int);
 FUNC(int)    cha_fft_cr(float *, int);
+FUNC(int)    cha_fft_cr_pl(float *, int, void *);
+FUNC(void *) cha_fft_plan(CHA_PTR, int, int);
+FUNC(void *) cha_fftq_plan(CHA_PTR, int, int);
+FUNC(void)   cha_fftq_cr(int *, int, void *);
+FUNC(void)   cha_fftq_rc(int *, int, void *);
 FUNC(int)    cha_fft_rc(float *, int);
+FUNC(int)    cha_fft_rc_pl(float *, int, void *);
+FUNC(unsigned int) cha_fpu_guard(void);
+FUNC(void)   cha_fpu_restore(unsigned int);
+FUNC(CHA_PTR) cha_instance(CHA_PTR, int *, int);
 FUNC(void)   cha_prepare(CHA_PTR);
 FUNC(void)   cha_scale(float *, int, float);
+FUNC(void)   cha_swap(CHA_PTR, int, int);
 FUNC(float)  cha_undb1(float);
+FUNC(void)   cha_undb1_vec(const float *, float *, int);
 FUNC(float)  cha_undb2(float);
+FUNC(void)   cha_undb2_vec(const float *, float *, int);
+FUNC(void *) cha_writable(CHA_PTR, int);
 FUNC(char *) cha_version(void);
 
 /*****************************************************/
@@ -66,5 +97,8 @@ FUNC(char *) cha_version(void);
 #define _ivar     1
 #define _dvar     2
 #define _reserve  3
+#define _arena    (NPTR-1)  // packed & borrowed arrays (cha_arena_pack, cha_data_init)
+
+#define CHA_ALIGN 64        // alignment of the packed arrays (bytes)
 
 #endif /* CHAPRO_H */
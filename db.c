@@ -5,34 +5,45 @@
 //include <assert.h>
 #include "chapro.h"
 #include "cha_ff.h"
+#include "cha_simd.h"
 
 
 // METHOD: 0=exact, 1=polynomial_ratio, 2=lookup_table
+// (default; can be changed at run time with cha_db_method)
 #define METHOD 2
 
+static int db_method = METHOD;
+
 /***********************************************************/
 
-#if METHOD == 1
+// polynomial ratio coefficients
+
+#define PA0     -206059.514f    // pow
+#define PA1     -72102.2578f
+#define PA2     -11240.0288f
+#define PA3     -989.027847f
+#define PB0     -206059.514f
+#define PB1     70727.3131f
+#define PB2     -10763.5093f
+#define PB3     -14.5169712f
+#define LA0     75.1518561f     // log
+#define LA1     -134.730400f
+#define LA2     74.2011014f
+#define LB0     37.5759281f
+#define LB1     -79.8905092f
+#define LB2     56.2155348f
 
 static __inline float
 pow_pr(float x) // approximate 2^x
 {
     float p, q;
     int   n;
-    static float a0 = -206059.514;
-    static float a1 = -72102.2578;
-    static float a2 = -11240.0288;
-    static float a3 = -989.027847;
-    static float b0 = -206059.514;
-    static float b1 = 70727.3131;
-    static float b2 = -10763.5093;
-    static float b3 = -14.5169712;
 
     // assume: x > -0.5 and x < 0.5
     n = (x < 0);
     if (n) x = -x;
-    p = (((a3 * x + a2) * x + a1) * x + a0);
-    q = (((b3 * x + b2) * x + b1) * x + b0);
+    p = (((PA3 * x + PA2) * x + PA1) * x + PA0);
+    q = (((PB3 * x + PB2) * x + PB1) * x + PB0);
     if (n) return (q / p);
     return (p / q);
 }
@@ -41,23 +52,15 @@ static __inline float
 log_pr(float x) // approximate ln(x)
 {
     float p, q, z, z2;
-    static float a0 = 75.1518561;
-    static float a1 = -134.730400;
-    static float a2 = 74.2011014;
-    static float b0 = 37.5759281;
-    static float b1 = -79.8905092;
-    static float b2 = 56.2155348;
 
     // assume: x > sqrt(1/2) and x < sqrt(2)
     z = (x - 1) / (x + 1);
     z2 = z * z;
-    p = ((a2 * z2 + a1) * z2 + a0);
-    q = ((b2 * z2 + b1) * z2 + b0);
+    p = ((LA2 * z2 + LA1) * z2 + LA0);
+    q = ((LB2 * z2 + LB1) * z2 + LB0);
     return (z * p / q);
 }
 
-#elif METHOD == 2
-
 static __inline float
 pow_lu(float x) // approximate 2^x
 {
@@ -152,130 +155,251 @@ log_lu(float x) // approximate ln(x)
     return ((1 - f) * lu[i] + f * lu[i + 1]);
 }
 
-#endif // METHOD
-
 /***********************************************************/
 
-FUNC(float)
-cha_db1(float x) // 10 * log10(x)
+// Range reduction works on the IEEE-754 bits: x = 2^e * m with
+// sqrt(0.5) <= m < sqrt(2) for the log, and 2^e is built directly
+// in the exponent field for the power, so frexpf/ldexpf are not needed.
+
+#define SQRTH_BITS  0x3F3504F3          // bits of sqrt(0.5)
+#define LN2         0.693147182f        // log(2)
+#define DB_LO       1.17549435e-38f     // smallest magnitude (normal)
+#define DB_HI       1e38f               // largest magnitude
+#define P2_LO       -126.0f             // smallest power of 2
+#define P2_HI       126.0f              // largest power of 2
+#define C_DB1       4.34294462f         // 10 / log(10)
+#define C_DB2       8.68588924f         // 20 / log(10)
+#define C_UNDB1     0.332192809f        // log(10) / (10 * log(2))
+#define C_UNDB2     0.166096404f        // log(10) / (20 * log(2))
+
+typedef union { float f; int i; } db_bits;
+
+static __inline float
+log_mt(float m, int mt) // ln(m) for sqrt(0.5) <= m < sqrt(2)
+{
+    switch (mt) {
+    case 0:  return (logf(m)); // exact
+    case 1:  return (log_pr(m));
+    default: return (log_lu(m));
+    }
+}
+
+static __inline float
+pow_mt(float m, int mt) // 2^m for -0.5 <= m < 0.5
+{
+    switch (mt) {
+    case 0:  return (powf(2, m)); // exact
+    case 1:  return (pow_pr(m));
+    default: return (pow_lu(m));
+    }
+}
+
+static __inline float
+db_log(float x, int mt) // ln(x), clipped to magnitudes DB_LO to DB_HI
+{
+    db_bits b;
+    int e;
+
+    x = (x < DB_LO) ? DB_LO : x;
+    x = (x > DB_HI) ? DB_HI : x;
+    b.f = x;
+    e = (b.i - SQRTH_BITS) >> 23;       // arithmetic shift
+    b.i -= e * (1 << 23);
+    return (log_mt(b.f, mt) + LN2 * e);
+}
+
+static __inline float
+db_pow2(float x, int mt) // 2^x, clipped to powers P2_LO to P2_HI
 {
-    float m, ln;
+    db_bits b;
     int e;
-    static float c1 = 1e-38;
-    static float c2 = -380;
-    static float c3 = 1e38;
-    static float c4 = 380;
-    static float c5 = 0.707106769; // sqrt(0.5)
-    static float c6 = 4.34294462;  // 10 / log(10)
-    static float c7 = 0.693147182; // log(2);
-
-    if (x < c1) return (c2);
-    if (x > c3) return (c4);
-    m = frexpf(x, &e);
-    if (m < c5) {
-        m *= 2;
-  e--;
+
+    x = (x < P2_LO) ? P2_LO : x;
+    x = (x > P2_HI) ? P2_HI : x;
+    e = (int) (x + 128.5f) - 128;       // round to nearest
+    b.i = (e + 127) << 23;              // 2^e
+    return (pow_mt(x - e, mt) * b.f);
+}
+
+#if defined(CHA_SIMD) && defined(vf_div)
+
+// polynomial ratio (METHOD 1) on CHA_SIMD values at a time
+
+static int
+db_log_v(const float *x, float *y, int n, float c)
+{
+    cha_vf vx, vm, vz, vz2, vp, vq, vc, vl, vh, v1, vl2;
+    cha_vi vi, ve;
+    int i;
+
+    vc = vf_dup(c);
+    vl = vf_dup(DB_LO);
+    vh = vf_dup(DB_HI);
+    v1 = vf_dup(1);
+    vl2 = vf_dup(LN2);
+    for (i = 0; (i + CHA_SIMD) <= n; i += CHA_SIMD) {
+        vx = vf_max(vf_min(vf_load(x + i), vh), vl);
+        vi = vf_asvi(vx);
+        ve = vi_sra(vi_sub(vi, vi_dup(SQRTH_BITS)), 23);
+        vm = vi_asvf(vi_sub(vi, vi_sll(ve, 23)));
+        vz = vf_div(vf_sub(vm, v1), vf_add(vm, v1));
+        vz2 = vf_mul(vz, vz);
+        vp = vf_add(vf_mul(vf_add(vf_mul(vf_dup(LA2), vz2), vf_dup(LA1)), vz2), vf_dup(LA0));
+        vq = vf_add(vf_mul(vf_add(vf_mul(vf_dup(LB2), vz2), vf_dup(LB1)), vz2), vf_dup(LB0));
+        vx = vf_add(vf_div(vf_mul(vz, vp), vq), vf_mul(vl2, vi_cvt(ve)));
+        vf_store(y + i, vf_mul(vc, vx));
     }
-#if METHOD == 0
-    ln = logf(m); // exact
-#elif METHOD == 1
-    ln = log_pr(m);
-#elif METHOD == 2
-    ln = log_lu(m);
-#endif
-    return (c6 * (ln + c7 * e));
+    return (i);
 }
 
-FUNC(float)
-cha_undb1(float x) // 10 ^ (x / 10)
+static int
+db_pow2_v(const float *x, float *y, int n, float c)
 {
-    float m, p2;
-    int   e;
-    static float c1 = 1e-38;
-    static float c2 = -380;
-    static float c3 = 1e38;
-    static float c4 = 380;
-    static float c5 = 0.166096404; // log(10) / (20 * log(2))
-
-    if (x < c2) return (c1);
-    if (x > c4) return (c3);
-    x *= c5;
-    e = (int) x;
-    m = x - e;
-    if (m < -0.5) {
-        m++;
-        e--;
-    } else if (m > 0.5) {
-        m--;
-        e++;
+    cha_vf vx, vm, va, vp, vq, vc, vl, vh, v0;
+    cha_vi ve;
+    cha_vm neg;
+    int i;
+
+    vc = vf_dup(c);
+    vl = vf_dup(P2_LO);
+    vh = vf_dup(P2_HI);
+    v0 = vf_dup(0);
+    for (i = 0; (i + CHA_SIMD) <= n; i += CHA_SIMD) {
+        vx = vf_max(vf_min(vf_mul(vf_load(x + i), vc), vh), vl);
+        ve = vi_sub(vf_cvt(vf_add(vx, vf_dup(128.5f))), vi_dup(128));
+        vm = vf_sub(vx, vi_cvt(ve));
+        va = vf_abs(vm);
+        vp = vf_add(vf_mul(vf_add(vf_mul(vf_add(vf_mul(vf_dup(PA3), va), 
+            vf_dup(PA2)), va), vf_dup(PA1)), va), vf_dup(PA0));
+        vq = vf_add(vf_mul(vf_add(vf_mul(vf_add(vf_mul(vf_dup(PB3), va), 
+            vf_dup(PB2)), va), vf_dup(PB1)), va), vf_dup(PB0));
+        neg = vf_ge(v0, vm);
+        vm = vf_div(vf_sel(neg, vq, vp), vf_sel(neg, vp, vq));
+        vf_store(y + i, vf_mul(vm, vi_asvf(vi_sll(vi_add(ve, vi_dup(127)), 23))));
     }
-#if METHOD == 0
-    p2 = powf(2, m); // exact
-#elif METHOD == 1
-    p2 = pow_pr(m); 
-#elif METHOD == 2
-    p2 = pow_lu(m); 
-#endif
-    return (ldexpf(p2, e));
+    return (i);
 }
 
+#else
+#define db_log_v(x,y,n,c)   0
+#define db_pow2_v(x,y,n,c)  0
+#endif
+
 /***********************************************************/
 
+// select accuracy of the dB conversions: 0=exact,
+// 1=polynomial_ratio, 2=lookup_table; returns previous method
+FUNC(int)
+cha_db_method(int method)
+{
+    int prev;
+
+    prev = db_method;
+    if ((method >= 0) && (method <= 2)) {
+        db_method = method;
+    }
+    return (prev);
+}
+
+FUNC(float)
+cha_db1(float x) // 10 * log10(x)
+{
+    return (C_DB1 * db_log(x, db_method));
+}
+
+FUNC(float)
+cha_undb1(float x) // 10 ^ (x / 10)
+{
+    return (db_pow2(C_UNDB1 * x, db_method));
+}
+
 FUNC(float)
 cha_db2(float x) // 20 * log10(x)
 {
-    float m, ln;
-    int e;
-    static float c1 = 1e-38;
-    static float c2 = -760;
-    static float c3 = 1e38;
-    static float c4 = 760;
-    static float c5 = 0.707106769; // sqrt(0.5)
-    static float c6 = 8.68588924;  // 20 / log(10)
-    static float c7 = 0.693147182; // log(2);
-
-    if (x < c1) return (c2);
-    if (x > c3) return (c4);
-    m = frexpf(x, &e);
-    if (m < c5) {
-        m *= 2;
-  e--;
-    }
-    // assume: x > sqrt(0.5) and x < sqrt(2)
-#if METHOD == 0
-    ln = logf(m); // exact
-#elif METHOD == 1
-    ln = log_pr(m);
-#elif METHOD == 2
-    ln = log_lu(m);
-#endif
-    return (c6 * (ln + c7 * e));
+    return (C_DB2 * db_log(x, db_method));
 }
 
 FUNC(float)
 cha_undb2(float x) // 10 ^ (x / 20)
 {
-    float m, p2;
-    int   e;
-    static float c1 = 1e-38;
-    static float c2 = -760;
-    static float c3 = 1e38;
-    static float c4 = 760;
-    static float c5 = 0.166096404; // log(10) / (20 * log(2))
-
-    if (x < c2) return (c1);
-    if (x > c4) return (c3);
-    x *= c5;
-    e = (int) ((x < 0) ? (x - 0.5) : (x + 0.5));
-    m = x - e;
-    // assume: x > -0.5 and x < 0.5
-#if METHOD == 0
-    p2 = powf(2, m); // exact
-#elif METHOD == 1
-    p2 = pow_pr(m); 
-#elif METHOD == 2
-    p2 = pow_lu(m); 
-#endif
-    return (ldexpf(p2, e));
+    return (db_pow2(C_UNDB2 * x, db_method));
+}
+
+/***********************************************************/
+
+// array versions: the method is selected once per call, so each
+// loop below has its approximation inlined; the polynomial ratio
+// runs on SIMD lanes when available, leaving only the remainder
+// (x and y may be the same array)
+
+static void
+db_log_n(const float *x, float *y, int n, float c)
+{
+    int i;
+
+    switch (db_method) {
+    case 0:
+        for (i = 0; i < n; i++) {
+            y[i] = c * db_log(x[i], 0);
+        }
+        break;
+    case 1:
+        for (i = db_log_v(x, y, n, c); i < n; i++) {
+            y[i] = c * db_log(x[i], 1);
+        }
+        break;
+    default:
+        for (i = 0; i < n; i++) {
+            y[i] = c * db_log(x[i], 2);
+        }
+        break;
+    }
+}
+
+static void
+db_pow2_n(const float *x, float *y, int n, float c)
+{
+    int i;
+
+    switch (db_method) {
+    case 0:
+        for (i = 0; i < n; i++) {
+            y[i] = db_pow2(c * x[i], 0);
+        }
+        break;
+    case 1:
+        for (i = db_pow2_v(x, y, n, c); i < n; i++) {
+            y[i] = db_pow2(c * x[i], 1);
+        }
+        break;
+    default:
+        for (i = 0; i < n; i++) {
+            y[i] = db_pow2(c * x[i], 2);
+        }
+        break;
+    }
 }
 
+FUNC(void)
+cha_db1_vec(const float *x, float *y, int n) // 10 * log10(x)
+{
+    db_log_n(x, y, n, C_DB1);
+}
+
+FUNC(void)
+cha_undb1_vec(const float *x, float *y, int n) // 10 ^ (x / 10)
+{
+    db_pow2_n(x, y, n, C_UNDB1);
+}
+
+FUNC(void)
+cha_db2_vec(const float *x, float *y, int n) // 20 * log10(x)
+{
+    db_log_n(x, y, n, C_DB2);
+}
+
+FUNC(void)
+cha_undb2_vec(const float *x, float *y, int n) // 10 ^ (x / 20)
+{
+    db_pow2_n(x, y, n, C_UNDB2);
+}
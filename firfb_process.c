@@ -6,38 +6,76 @@
 #include <assert.h>
 #include "chapro.h"
 #include "cha_ff.h"
+#include "cha_fix.h"
 
 //Added for ARM FFT/IFFT processing
-#define USE_ARM_MATH 1
-#if USE_ARM_MATH == 1
-  #include <arm_math.h>
-  #define ARM_NFFT (128*2)   //CHUNK_SIZE * 2...YOU MUST SET THIS VALUE YOURSELF!
-  #if (ARM_NFFT == 64) || (ARM_NFFT == 256)
-    #define ARM_FFT_INST_TYPE arm_cfft_radix4_instance_f32  //radix 4 is for NFFT=64 and NFFT=256
-    #define ARM_FFT_INIT_FUNC arm_cfft_radix4_init_f32
-    #define ARM_FFT_FUNC arm_cfft_radix4_f32
+#ifndef USE_ARM_MATH
+  #if defined(__arm__)
+    #define USE_ARM_MATH 1
   #else
-    #define ARM_FFT_INST_TYPE arm_cff_radix2_instance_f32  //radix 2 is for NFFT=32 and NFFT=128
-    #define ARM_FFT_INIT_FUNC arm_cfft_radix2_init_f32
-    #define ARM_FFT_FUNC arm_cfft_radix2_f32
+    #define USE_ARM_MATH 0  //host builds use the rfft.c transforms
   #endif
+#endif
+#if USE_ARM_MATH == 1
+  #include <arm_math.h>
+  #define USE_ARM_RFFT 1     //1 = real FFT on packed half spectra, 0 = full complex FFT of 2*nw points
 
-  //create ARM Math FFT instances
-  ARM_FFT_INST_TYPE cfft_inst1, cifft_inst1; 
-
-  //create temporary memory
-  float xx_temp[2*ARM_NFFT], yy_temp[2*ARM_NFFT];
+  //The ARM Math FFT instances live in the CHA_PTR (_ffai), along with their temporary
+  //memory (_ffwk), so that each pipeline owns its own workspace.  The FFT size is taken
+  //from the prescription (2*nw) when cha_firfb_setup() is called, not at compile time.
+  typedef struct {
+      int nfft;                                //FFT size these instances were set up for
+    #if USE_ARM_RFFT == 1
+      arm_rfft_fast_instance_f32 rfft;         //any power of two from 32 to 4096.  does both directions
+    #else
+      int radix4;                              //radix 4 for NFFT=64, 256, 1024.  radix 2 otherwise
+      arm_cfft_radix4_instance_f32 r4[2];      //FFT, IFFT
+      arm_cfft_radix2_instance_f32 r2[2];      //FFT, IFFT
+    #endif
+  } ARM_FFT_INST;
 
   //define initialization functions
-  static void initialize_ARM_FFT(void) {
-      uint8_t ifftFlag; // 0 is FFT, 1 is IFFT
+  static int initialize_ARM_FFT(ARM_FFT_INST *ai, int nfft) {
+      arm_status status;
+
+      if (ai->nfft == nfft) return 0;  //already set up for this size
+    #if USE_ARM_RFFT == 1
+      status = arm_rfft_fast_init_f32(&ai->rfft, nfft);
+    #else
       uint8_t doBitReverse = 1;
+      int m = 0;
+      while ((1 << m) < nfft) m++;
+      ai->radix4 = ((m % 2) == 0);  //power of four?
+      if (ai->radix4) {
+        status = arm_cfft_radix4_init_f32(&ai->r4[0], nfft, 0, doBitReverse); //init FFT
+        if (status == ARM_MATH_SUCCESS) status = arm_cfft_radix4_init_f32(&ai->r4[1], nfft, 1, doBitReverse); //init IFFT
+      } else {
+        status = arm_cfft_radix2_init_f32(&ai->r2[0], nfft, 0, doBitReverse); //init FFT
+        if (status == ARM_MATH_SUCCESS) status = arm_cfft_radix2_init_f32(&ai->r2[1], nfft, 1, doBitReverse); //init IFFT
+      }
+    #endif
+      ai->nfft = (status == ARM_MATH_SUCCESS) ? nfft : 0;  //zero means "not usable"
+      return (status != ARM_MATH_SUCCESS);
+  }
 
-      ifftFlag = 0; //zero says to setup as FFT
-      int FFT_allocation_status = ARM_FFT_INIT_FUNC(&cfft_inst1, ARM_NFFT, ifftFlag, doBitReverse); //init FFT
+  #if USE_ARM_RFFT == 0
+  static void arm_fft(ARM_FFT_INST *ai, float *data, int inverse) {
+      //run the complex FFT (inverse = 0) or IFFT (inverse = 1) in place, with the radix chosen at setup
+      if (ai->radix4) {
+        arm_cfft_radix4_f32(&ai->r4[inverse], data);
+      } else {
+        arm_cfft_radix2_f32(&ai->r2[inverse], data);
+      }
+  }
+  #endif
 
-      ifftFlag = 1; //one says to setup as IFFT
-      int IFFT_allocation_status = ARM_FFT_INIT_FUNC(&cifft_inst1, ARM_NFFT, ifftFlag, doBitReverse); //init IFFT  
+  static void cmul_packed(float *z, float *x, float *h, int n_fft) {
+      //complex multiply of a packed real-FFT spectrum x (DC in [0] and Nyquist in [1], followed by
+      //bins 1 to n_fft/2-1) by the positive frequency space h (bins 0 to n_fft/2). Output z is packed, too.
+      const int ind_nyquist_bin = n_fft / 2;
+      z[0] = x[0] * h[0];                   //DC.  only the real part survives the inverse real FFT
+      z[1] = x[1] * h[2*ind_nyquist_bin];   //Nyquist.  only the real part survives, too
+      arm_cmplx_mult_cmplx_f32(x + 2, h + 2, z + 2, ind_nyquist_bin - 1);
   }
 
   static void rebuildNegFreqBins(float data[], int n_fft) {
@@ -59,7 +97,7 @@
 
 // complex multiply: z = x * y
 static __inline void
-cmul(float *z, float *x, float *y, int n)
+cmul(float *CHA_RESTRICT z, float *CHA_RESTRICT x, float *CHA_RESTRICT y, int n)
 {
     int      i, ir, ii;
 
@@ -71,133 +109,707 @@ cmul(float *z, float *x, float *y, int n)
     }
 }
 
+// complex multiply-accumulate: z += x * y
+static __inline void
+cmac(float *CHA_RESTRICT z, float *CHA_RESTRICT x, float *CHA_RESTRICT y, int n)
+{
+    int      i, ir, ii;
+
+    for (i = 0; i < n; i++) {
+        ir = i * 2;
+        ii = i * 2 + 1;
+        z[ir] += x[ir] * y[ir] - x[ii] * y[ii];
+        z[ii] += x[ir] * y[ii] + x[ii] * y[ir];
+    }
+}
+
+// FIR-filterbank analysis for short chunk (cs < nw) using a uniformly
+// partitioned frequency-domain delay line: the spectra of the last nk
+// input chunks are kept in fd (newest first), each channel sums all nk
+// partition products and needs only one inverse FFT per chunk
+
+// shift delay line & transform new chunk (shared by all channels)
+static __inline void
+firfb_xform_up(float *x, int cs, float *fd, int nw, void *pl)
+{
+    int      nk, ns, nt;
+
+    nk = nw / cs;
+    nt = cs * 2;
+    ns = nt + 2;
+    fmove(fd + ns, fd, (nk - 1) * ns);
+    fcopy(fd, x, cs);
+    fzero(fd + cs, ns - cs);
+    cha_fft_rc_pl(fd, nt, pl);
+}
+
+// filter chunk into one channel
+static __inline void
+firfb_chan_up(float *CHA_RESTRICT yk, int cs, float *hk, float *fd, 
+    float *CHA_RESTRICT yy, float *CHA_RESTRICT zk, int nw, void *pl)
+{
+    int      i, j, nf, ns, nt, nk;
+
+    nk = nw / cs;
+    nt = cs * 2;
+    nf = cs + 1;
+    ns = nf * 2;
+    #if USE_ARM_MATH
+      arm_cmplx_mult_cmplx_f32(fd, hk, yy, nf);
+    #else
+      cmul(yy, fd, hk, nf);
+    #endif
+    for (j = 1; j < nk; j++) {
+        cmac(yy, fd + j * ns, hk + j * ns, nf);
+    }
+    cha_fft_cr_pl(yy, nt, pl);
+    // overlap-add with tail of previous chunk
+    for (i = 0; i < cs; i++) {
+        yk[i] = yy[i] + zk[i];
+    }
+    fcopy(zk, yy + cs, cs);
+}
+
 // FIR-filterbank analysis for short chunk (cs < nw)
+
+// transform input chunk once for all channels
+static __inline void
+firfb_xform_sc(float *x, int cs, float *xx, void *pl)
+{
+    int      nt;
+
+    nt = cs * 2;
+    fzero(xx, nt);
+    fcopy(xx, x, cs);
+    cha_fft_rc_pl(xx, nt, pl);
+}
+
+// filter chunk into one channel
 static __inline void
-firfb_analyze_sc(float *x, float *y, int cs,
-    float *hh, float *xx, float *yy, float *zz, int nc, int nw)
+firfb_chan_sc(float *CHA_RESTRICT yk, int cs, float *hk, float *xx, 
+    float *CHA_RESTRICT yy, float *CHA_RESTRICT zk, int nw, void *pl)
 {
-    float   *hk, *yk, *zk;
-    int      i, j, k, nf, ns, nt, nk;
+    int      i, j, nf, ns, nt, nk;
 
     nk = nw / cs;
     nt = cs * 2;
     nf = cs + 1;
     ns = nf * 2;
-    // loop over channels
-    for (k = 0; k < nc; k++) {
-        fzero(xx, nt);
-        fcopy(xx, x, cs);
-        cha_fft_rc(xx, nt);
-        // loop over sub-window segments
-        yk = y + k * cs;
-        zk = zz + k * (nw + cs);
-        for (j = 0; j < nk; j++) {
-            hk = hh + (k * nk + j) * ns;
-            #if USE_ARM_MATH
-              arm_cmplx_mult_cmplx_f32(xx, hk, yy, nf);
-            #else
-              cmul(yy, xx, hk, nf);
-            #endif
-            cha_fft_cr(yy, nt);
-            for (i = 0; i < nt; i++) {
-                zk[i + j * cs] += yy[i];
-            }
+    // loop over sub-window segments
+    for (j = 0; j < nk; j++) {
+        #if USE_ARM_MATH
+          arm_cmplx_mult_cmplx_f32(xx, hk + j * ns, yy, nf);
+        #else
+          cmul(yy, xx, hk + j * ns, nf);
+        #endif
+        cha_fft_cr_pl(yy, nt, pl);
+        for (i = 0; i < nt; i++) {
+            zk[i + j * cs] += yy[i];
         }
-        fcopy(yk, zk, cs);
-        fmove(zk, zk + cs, nw);
-        fzero(zk + nw, cs);
     }
+    fcopy(yk, zk, cs);
+    fmove(zk, zk + cs, nw);
+    fzero(zk + nw, cs);
 }
 
-// FIR-filterbank analysis for long chunk (cs >= nw)
+// FIR-filterbank analysis for long chunk (cs >= nw), one sub-chunk
+// segment of ni <= nw samples at a time
+
+// transform segment once for all channels
+static __inline void
+firfb_xform_lc(float *x, int ni, float *xx, int nw, void *pl)
+{
+    int      nt;
+
+    nt = nw * 2;
+    fzero(xx, nt);
+    fcopy(xx, x, ni);
+    cha_fft_rc_pl(xx, nt, pl);
+}
+
+// filter segment into one channel
+static __inline void
+firfb_chan_lc(float *CHA_RESTRICT yk, int ni, float *hk, float *xx, 
+    float *CHA_RESTRICT yy, float *CHA_RESTRICT zk, int nw, void *pl)
+{
+    int      i, nf, nt;
+
+    nt = nw * 2;
+    nf = nw + 1;
+    cmul(yy, xx, hk, nf);
+    cha_fft_cr_pl(yy, nt, pl);
+    for (i = 0; i < ni; i++) {
+        yk[i] = yy[i] + zk[i];
+    }
+    fcopy(zk, yy + ni, nw);
+}
+
+#if USE_ARM_MATH
+// FIR-filterbank analysis for long chunk (cs >= nw) using the ARM Math FFT
+
+//transform segment once for all channels
 static __inline void
-firfb_analyze_lc(float *x, float *y, int cs,
-    float *hh, float *xx, float *yy, float *zz, int nc, int nw)
+firfb_xform_lc_arm(float *x, int ni, float *xx, int nw, ARM_FFT_INST *ai, float *xx_temp)
 {
-    float   *hk, *yk, *zk;
-    int      i, j, k, nf, nt, ni;
+    int      k, nt;
     
     //nw = 128;  //length of window of new data
+    nt = nw * 2; //length of FFT transform is 256 points. (will zero pad the last half)
+    #if USE_ARM_RFFT
+       fcopy(xx_temp, x, ni);
+       fzero(xx_temp + ni, nt - ni);  //zero pad the rest of the buffer
+       arm_rfft_fast_f32(&ai->rfft, xx_temp, xx, 0); //DSP accelerated.  xx is the packed half spectrum
+    #else
+       for (k = 0; k < ni; k++) { xx_temp[2*k]=x[k]; xx_temp[2*k+1]=0.0f;} //ni = nw = 128
+       for (k=ni; k < nt; k++) { xx_temp[2*k]=0.0f; xx_temp[2*k+1] = 0.0f; } ///zero pad the rest of the buffer
+       arm_fft(ai, xx_temp, 0); //DSP accelerated
+    #endif
+}
+
+//filter segment into one channel
+static __inline void
+firfb_chan_lc_arm(float *yk, int ni, float *hk, float *xx, float *yy, float *zk, 
+    int nw, ARM_FFT_INST *ai, float *xx_temp, float *yy_temp)
+{
+    int      i, nf, nt;
+
     nt = nw * 2; //length of FFT transform is 256 points. (will zero pad the last half)
     nf = nw + 1; //length of positive frequeny space of FFT data (ie, DC through Nyquist..128+1 = 129
-        
-    // loop over sub-chunk segments
-    for (j = 0; j < cs; j += nw) {
-        ni = ((cs - j) < nw) ? (cs - j) : nw;
-        
-        #if USE_ARM_MATH
-           for (k = 0; k < ni; k++) { xx_temp[2*k]=x[k+j]; xx_temp[2*k+1]=0.0f;} //ni = nw = 128
-           for (k=ni; k < nt; k++) { xx_temp[2*k]=0.0f; xx_temp[2*k+1] = 0.0f; } ///zero pad the rest of the buffer
-           ARM_FFT_FUNC(&cfft_inst1, xx_temp); //DSP accelerated
-        #else
-          fzero(xx, nt);
-          fcopy(xx, x + j, ni);        
-          cha_fft_rc(xx, nt); //FFT
-        #endif
-          
-        // loop over channels
-        for (k = 0; k < nc; k++) {     
-            hk = hh + k * nf * 2;
-            #if USE_ARM_MATH
-              arm_cmplx_mult_cmplx_f32(xx_temp, hk, yy_temp, nf); //complex multiply (ie, create the current channel)
-              rebuildNegFreqBins(yy_temp, nt); //nt is 256
-              ARM_FFT_FUNC(&cifft_inst1, yy_temp); //DSP accelerated.  Need to divide each element ,by n????
-            #else
-              cmul(yy, xx, hk, nf); //complex multiply (ie, create the current channel)
-              cha_fft_cr(yy, nt);   //IFFT
-            #endif
-            
-            yk = y + k * cs;
-            zk = zz + k * nw;
-
-            #if USE_ARM_MATH
-              //yy is interleaved real-complex-real-complex...just get the real part.
-              for (i = 0; i < ni; i++)  yk[i + j] = yy_temp[2*i] + zk[i];
-
-              //copy out the state of the system (the output that had been the zero pad...again, just the real part)
-              float *yy_foo = yy_temp + 2*ni;  
-              for (i = 0; i < nw; i++)  zk[i] = yy_foo[2*i];  //WEA MODDED...replaces fcopy(zk, yy + ni, nw);
-            #else
-              for (i = 0; i < ni; i++) {  yk[i + j] = yy[i] + zk[i]; }
-              fcopy(zk, yy + ni, nw);
-            #endif
+    #if USE_ARM_RFFT
+      cmul_packed(yy_temp, xx, hk, nt); //complex multiply (ie, create the current channel)
+      arm_rfft_fast_f32(&ai->rfft, yy_temp, yy, 1); //DSP accelerated inverse, includes the 1/n scaling
+      for (i = 0; i < ni; i++) {  yk[i] = yy[i] + zk[i]; }
+      fcopy(zk, yy + ni, nw);
+    #else
+      arm_cmplx_mult_cmplx_f32(xx_temp, hk, yy_temp, nf); //complex multiply (ie, create the current channel)
+      rebuildNegFreqBins(yy_temp, nt); //nt is 256
+      arm_fft(ai, yy_temp, 1); //DSP accelerated.  includes the 1/n scaling
+
+      //yy is interleaved real-complex-real-complex...just get the real part.
+      for (i = 0; i < ni; i++)  yk[i] = yy_temp[2*i] + zk[i];
+
+      //copy out the state of the system (the output that had been the zero pad...again, just the real part)
+      float *yy_foo = yy_temp + 2*ni;  
+      for (i = 0; i < nw; i++)  zk[i] = yy_foo[2*i];  //WEA MODDED...replaces fcopy(zk, yy + ni, nw);
+    #endif
+}
+#endif
+
+// transform one segment of input (ni <= min(cs,nw) samples), for
+// the chunk size cs & window size nw of the setup
+static __inline void
+firfb_xform(CHA_CTX *cx, float *x, int ni, int cs, int nw)
+{
+    if (cs < nw) {
+        if (cx->fd) {
+            firfb_xform_up(x, cs, cx->fd, nw, cx->pl);
+        } else {
+            firfb_xform_sc(x, cs, cx->xx, cx->pl);
         }
+        return;
     }
+    #if USE_ARM_MATH
+      if (cx->ai) {
+          firfb_xform_lc_arm(x, ni, cx->xx, nw, (ARM_FFT_INST *) cx->ai, cx->wk);
+          return;
+      }
+    #endif
+    firfb_xform_lc(x, ni, cx->xx, nw, cx->pl);
 }
 
-// FIR-filterbank analysis
-FUNC(void)
-cha_firfb_analyze(CHA_PTR cp, float *x, float *y, int cs)
+// filter transformed segment into channel k
+static __inline void
+firfb_chan(CHA_CTX *cx, float *yk, int ni, int k, int cs, int nw)
 {
-    float   *hh, *xx, *yy, *zz;
-    int      nc, nw;
+    float   *hh, *zz;
+    int      nk;
+
+    if (cs < nw) {
+        nk = nw / cs;
+        hh = cx->hh + k * nk * (cs + 1) * 2;
+        zz = cx->zz + k * (nw + cs);
+        if (cx->fd) {
+            firfb_chan_up(yk, cs, hh, cx->fd, cx->yy, zz, nw, cx->pl);
+        } else {
+            firfb_chan_sc(yk, cs, hh, cx->xx, cx->yy, zz, nw, cx->pl);
+        }
+        return;
+    }
+    hh = cx->hh + k * (nw + 1) * 2;
+    zz = cx->zz + k * nw;
     #if USE_ARM_MATH
-      static int firstTime = 1;
-      //This will get checked every time.  But, without making this a class, I don't know how to do this.
-      if (firstTime) {  initialize_ARM_FFT();  firstTime = 0; }
+      if (cx->ai) {
+          ARM_FFT_INST *ai = (ARM_FFT_INST *) cx->ai;
+          firfb_chan_lc_arm(yk, ni, hh, cx->xx, cx->yy, zz, nw, ai, cx->wk, 
+              cx->wk + ai->nfft * 2);
+          return;
+      }
     #endif
+    firfb_chan_lc(yk, ni, hh, cx->xx, cx->yy, zz, nw, cx->pl);
+}
+
+/***********************************************************/
+
+// Half-precision responses: cha_firfb_half stores the filterbank
+// responses (_ffhh) as IEEE fp16 in _ffh16 and empties _ffhh, so that
+// cha_data_gen & cha_data_save write half the bytes; cha_firfb_setup
+// expands them again into a float working copy.  The responses are nc
+// rows of nb complex bins (all the partitions of a channel when
+// cs < nw).  Bins at either end of a row whose magnitude is below tol
+// times the row's largest are not stored and expand to zero.  Layout
+// (16-bit words): nb, 0, then for each row the first stored bin, the
+// number of stored bins and their re/im pairs; padded to 32 bits.
+
+// nearest fp16 of f (round half to even, saturating to infinity)
+static unsigned short
+half_from_float(float f)
+{
+    unsigned int u, s, e, m, r;
+
+    memcpy(&u, &f, sizeof(u));
+    s = (u >> 16) & 0x8000;
+    u &= 0x7FFFFFFF;
+    if (u >= 0x7F800000) {              // inf or nan
+        return ((unsigned short) (s | 0x7C00 | ((u > 0x7F800000) ? 0x200 : 0)));
+    }
+    if (u >= 0x477FF000) {              // rounds to >= 65536
+        return ((unsigned short) (s | 0x7C00));
+    }
+    if (u < 0x38800000) {               // fp16 subnormal or zero
+        if (u < 0x33000000) return ((unsigned short) s);
+        e = u >> 23;
+        m = (u & 0x7FFFFF) | 0x800000;
+        r = 126 - e;                    // shift to the subnormal unit 2^-24
+        u = m >> r;
+        m &= (1u << r) - 1;
+        r = 1u << (r - 1);
+        u += (m > r) || ((m == r) && (u & 1));
+        return ((unsigned short) (s | u));
+    }
+    u += 0xC8000FFF + ((u >> 13) & 1);  // rebias exponent, round to even
+    return ((unsigned short) (s | (u >> 13)));
+}
+
+static float
+half_to_float(unsigned short h)
+{
+    unsigned int u, e, m;
+    float f;
+
+    e = (h >> 10) & 0x1F;
+    m = h & 0x3FF;
+    if (e == 0) {
+        f = ldexpf((float) m, -24);
+        return ((h & 0x8000) ? -f : f);
+    }
+    u = ((unsigned int) (h & 0x8000) << 16) | (m << 13);
+    u |= (e == 31) ? 0x7F800000 : ((e + 112) << 23);
+    memcpy(&f, &u, sizeof(f));
+    return (f);
+}
+
+// stored bins [*k0,*k1) of a row of nb bins: those inside the first
+// & last whose magnitude exceeds tol times the row's largest
+static __inline void
+half_range(float *hk, int nb, double tol, int *k0, int *k1)
+{
+    float    a, amax;
+    int      j;
+
+    amax = 0;
+    for (j = 0; j < nb; j++) {
+        a = hk[2 * j] * hk[2 * j] + hk[2 * j + 1] * hk[2 * j + 1];
+        if (a > amax) amax = a;
+    }
+    amax *= (float) (tol * tol);
+    for (j = 0; j < nb; j++) {
+        if (hk[2 * j] * hk[2 * j] + hk[2 * j + 1] * hk[2 * j + 1] > amax) break;
+    }
+    *k0 = j;
+    for (j = nb; j > *k0; j--) {
+        if (hk[2 * j - 2] * hk[2 * j - 2] + hk[2 * j - 1] * hk[2 * j - 1] > amax) break;
+    }
+    *k1 = j;
+}
 
+// convert the responses to half precision, trimming the ends of each
+// row below tol (0 drops only zero bins, which loses nothing)
+FUNC(int)
+cha_firfb_half(CHA_PTR cp, double tol)
+{
+    float   *hh, *hk;
+    int      i, j, k, k0, k1, n, nb, nc;
+    unsigned short *hq;
+
+    hh = (float *) cp[_ffhh];
     nc = CHA_IVAR[_nc];
+    if ((hh == NULL) || (nc < 1)) {
+        return (1);
+    }
+    nb = ((int *) cp[_size])[_ffhh] / (int) sizeof(float) / 2 / nc;
+    if (nb > 0xFFFF) {
+        return (1);
+    }
+    n = 2;
+    for (k = 0; k < nc; k++) {
+        half_range(hh + k * nb * 2, nb, tol, &k0, &k1);
+        n += 2 + (k1 - k0) * 2;
+    }
+    hq = (unsigned short *) cha_allocate(cp, (n + 1) / 2, sizeof(int), _ffh16);
+    if (hq == NULL) {
+        return (1);
+    }
+    hq[0] = (unsigned short) nb;
+    i = 2;
+    for (k = 0; k < nc; k++) {
+        hk = hh + k * nb * 2;
+        half_range(hk, nb, tol, &k0, &k1);
+        hq[i++] = (unsigned short) k0;
+        hq[i++] = (unsigned short) (k1 - k0);
+        for (j = k0 * 2; j < k1 * 2; j++) {
+            hq[i++] = half_from_float(hk[j]);
+        }
+    }
+    cha_allocate(cp, 0, sizeof(float), _ffhh);
+
+    return (0);
+}
+
+// expand half-precision responses into the float _ffhh; _ffh16 may
+// come from a prescription image, so every count is checked against
+// the filterbank size and the slot size before it is used
+static int
+firfb_expand(CHA_PTR cp)
+{
+    float   *hh, *hk;
+    int      cs, i, j, k, k0, n, nb, nc, nq, nw;
+    unsigned short *hq;
+
+    hq = (unsigned short *) cp[_ffh16];
+    if (cp[_ffhh] || (hq == NULL)) {
+        return (0);
+    }
+    cs = CHA_IVAR[_cs];
     nw = CHA_IVAR[_nw];
-    hh = (float *) cp[_ffhh];
-    xx = (float *) cp[_ffxx];
-    yy = (float *) cp[_ffyy];
-    zz = (float *) cp[_ffzz];
+    nc = CHA_IVAR[_nc];
+    nq = ((int *) cp[_size])[_ffh16] / (int) sizeof(unsigned short);
+    if ((cs < 1) || (nw < 1) || (nc < 1) || (nq < 2)) {
+        return (1);
+    }
+    nb = hq[0];
+    if (nb != ((cs < nw) ? (nw / cs) * (cs + 1) : nw + 1)) {
+        return (1);
+    }
+    hh = (float *) cha_allocate(cp, nc * nb * 2, sizeof(float), _ffhh);
+    if (hh == NULL) {
+        return (1);
+    }
+    i = 2;
+    for (k = 0; k < nc; k++) {
+        if ((i + 2) > nq) {
+            break;
+        }
+        hk = hh + k * nb * 2;
+        k0 = hq[i++];
+        n = hq[i++];
+        if (((k0 + n) > nb) || ((i + n * 2) > nq)) {
+            break;
+        }
+        for (j = 0; j < n * 2; j++) {
+            hk[k0 * 2 + j] = half_to_float(hq[i++]);
+        }
+    }
+    if (k < nc) {       // truncated or corrupt: drop the partial responses
+        cha_allocate(cp, 0, sizeof(float), _ffhh);
+        return (1);
+    }
+
+    return (0);
+}
+
+// FIR-filterbank setup: create FFT plan for the transform size,
+// for short chunks the frequency-domain delay line, for long
+// chunks the ARM Math FFT instances and their workspace, and
+// the channel buffer used by cha_firfb_process
+FUNC(int)
+cha_firfb_setup(CHA_PTR cp)
+{
+    int      cs, nk, nt, nw;
+
+    if (firfb_expand(cp)) {
+        return (1);
+    }
+    cs = CHA_IVAR[_cs];
+    nw = CHA_IVAR[_nw];
+    nt = (cs < nw) ? cs * 2 : nw * 2;
+    if (cha_fft_plan(cp, nt, _ffpl) == NULL) {
+        return (1);
+    }
+    if (((int *) cp[_size])[_ffch] != (int) (nt / 2 * sizeof(float))) {
+        if (cha_allocate(cp, nt / 2, sizeof(float), _ffch) == NULL) {
+            return (1);
+        }
+    }
     if (cs < nw) {
-        firfb_analyze_sc(x, y, cs, hh, xx, yy, zz, nc, nw);
-    } else {
-        firfb_analyze_lc(x, y, cs, hh, xx, yy, zz, nc, nw);
+        nk = nw / cs;
+        if (cha_allocate(cp, nk * (nt + 2), sizeof(float), _fffd) == NULL) {
+            return (1);
+        }
+    }
+    #if USE_ARM_MATH
+      if (cs >= nw) {
+        ARM_FFT_INST *ai = (ARM_FFT_INST *) cp[_ffai];
+        if (ai == NULL) {
+            ai = (ARM_FFT_INST *) cha_allocate(cp, 1, sizeof(ARM_FFT_INST), _ffai);
+            if (ai == NULL) {
+                return (1);
+            }
+        }
+        if (initialize_ARM_FFT(ai, nt)) {
+            return (0);     // size not supported by ARM Math: use rfft.c
+        }
+        if (((int *) cp[_size])[_ffwk] != (int) (nt * 4 * sizeof(float))) {
+            if (cha_allocate(cp, nt * 4, sizeof(float), _ffwk) == NULL) {
+                ai->nfft = 0;   // keep cha_context off the ARM path
+                return (1);
+            }
+        }
+      }
+    #endif
+
+    return (0);
+}
+
+// FIR-filterbank setup for a pipeline that uses the FFT plan,
+// ARM Math instances, workspace & channel buffer of src, which
+// must have the same chunk size & window size; only the state
+// of cp is allocated.  The shared arrays belong to src: detach
+// them (see cha_bank_cleanup) before cha_cleanup(cp).
+FUNC(int)
+cha_firfb_share(CHA_PTR cp, CHA_PTR src)
+{
+    int      i, *cpsiz, *srcsiz;
+    static int shared[] = {_ffpl, _ffai, _ffwk, _ffch};
+    static int nshared = sizeof(shared) / sizeof(int);
+
+    if ((cp[_ivar] == NULL) || (src[_ivar] == NULL)) {
+        return (1);
+    }
+    if ((CHA_IVAR[_cs] != ((int *) src[_ivar])[_cs])
+        || (CHA_IVAR[_nw] != ((int *) src[_ivar])[_nw])) {
+        return (1);
+    }
+    cpsiz = (int *) cp[_size];
+    srcsiz = (int *) src[_size];
+    for (i = 0; i < nshared; i++) {
+        cp[shared[i]] = src[shared[i]];
+        cpsiz[shared[i]] = srcsiz[shared[i]];
+    }
+
+    return (cha_firfb_setup(cp));
+}
+
+// read the pipeline context of cp (see CHA_CTX in cha_ff.h)
+FUNC(void)
+cha_context(CHA_PTR cp, CHA_CTX *cx)
+{
+    cx->cp = cp;
+    cx->cs = CHA_IVAR[_cs];
+    cx->nw = CHA_IVAR[_nw];
+    cx->nc = CHA_IVAR[_nc];
+    cx->ngs = CHA_IVAR[_ngs];
+    cx->pl = cp[_ffpl];
+    cx->ai = NULL;
+    #if USE_ARM_MATH
+      //use the ARM Math FFT only if setup prepared it for this size
+      ARM_FFT_INST *ai = (ARM_FFT_INST *) cp[_ffai];
+      if (ai && (ai->nfft == cx->nw * 2)) {
+          cx->ai = ai;
+      }
+    #endif
+    cx->gcpar = cp[_gcpar];
+    cx->hh = (float *) cp[_ffhh];
+    cx->xx = (float *) cp[_ffxx];
+    cx->yy = (float *) cp[_ffyy];
+    cx->zz = (float *) cp[_ffzz];
+    cx->fd = (float *) cp[_fffd];
+    cx->wk = (float *) cp[_ffwk];
+    cx->ch = (float *) cp[_ffch];
+    cx->xpk = (float *) cp[_xpk];
+    cx->ppk = (float *) cp[_ppk];
+    cx->gcppk = (float *) cp[_gcppk];
+    cx->gcxpk = (float *) cp[_gcxpk];
+    cx->gcgn = (float *) cp[_gcgn];
+    cx->gctab = (float *) cp[_gctab];
+}
+
+// FIR-filterbank analysis
+FUNC(void)
+cha_firfb_analyze_cx(CHA_CTX *cx, float *x, float *y, int cs)
+{
+    int      j, k, nc, ni, ns, nw, cw;
+
+    nc = cx->nc;
+    nw = cx->nw;
+    cw = cx->cs;
+    ns = (cs < nw) ? cs : nw;
+    // loop over sub-chunk segments
+    for (j = 0; j < cs; j += ns) {
+        ni = ((cs - j) < ns) ? (cs - j) : ns;
+        firfb_xform(cx, x + j, ni, cw, nw);
+        // loop over channels
+        for (k = 0; k < nc; k++) {
+            firfb_chan(cx, y + k * cs + j, ni, k, cw, nw);
+        }
+    }
+}
+
+FUNC(void)
+cha_firfb_analyze(CHA_PTR cp, float *x, float *y, int cs)
+{
+    CHA_CTX cx;
+
+    cha_context(cp, &cx);
+    cha_firfb_analyze_cx(&cx, x, y, cs);
+}
+
+// fused pass with the chunk size, window size & channel count of the
+// setup as constants: each segment is filtered into all nc channels
+// of ch (nc*ns, on the caller's stack), the channels are compressed
+// together (cha_agc_channel_cx, envelopes side by side in the SIMD
+// lanes) and then summed into y
+static __inline void
+firfb_process_k(CHA_CTX *cx, float *x, float *y, int cs, int nw, int nc,
+    float *CHA_RESTRICT ch)
+{
+    float   *yj;
+    int      i, j, k, ns;
+
+    ns = (cs < nw) ? cs : nw;
+    // loop over sub-chunk segments
+    for (j = 0; j < cs; j += ns) {
+        yj = y + j;
+        firfb_xform(cx, x + j, ns, cs, nw);
+        for (k = 0; k < nc; k++) {
+            firfb_chan(cx, ch + k * ns, ns, k, cs, nw);
+        }
+        cha_agc_channel_cx(cx, ch, ch, ns);
+        fcopy(yj, ch, ns);
+        for (k = 1; k < nc; k++) {
+            for (i = 0; i < ns; i++) {
+                yj[i] += ch[k * ns + i];
+            }
+        }
+    }
+}
+
+// The configurations of the shipped cha_ff_data*.h headers (chunk
+// size, window size, channels), for which whole chunks go through
+// firfb_process_k with constant sizes and an nc*min(cs,nw) channel
+// buffer on the stack (4 kB at most, 8.5 kB with the envelopes of
+// compress_mc in agc_process.c); other configurations, partial chunks
+// and prescriptions without channel compressors use the run-time
+// sized pass, one channel at a time.
+#define FIRFB_SPEC(X)   X(32, 128, 8) X(128, 128, 8) X(256, 128, 8) X(128, 256, 8)
+
+#define FIRFB_CASE(CS, NW, NC) \
+    if ((n == CS) && (cs == CS) && (nw == NW) && (nc == NC)) { \
+        float chs[NC * ((CS < NW) ? CS : NW)]; \
+        firfb_process_k(cx, x, y, CS, NW, NC, chs); \
+        return; \
+    }
+
+// FIR-filterbank analysis, channel compression & synthesis in one
+// pass: each channel is filtered, compressed and added to the output
+// before the next one is started, so no nc*cs channel buffer is
+// needed; a prescription without channel compressors (e.g. FFIO) is
+// only filtered; requires cha_firfb_setup (x and y may be the same array)
+FUNC(void)
+cha_firfb_process_cx(CHA_CTX *cx, float *x, float *y, int n)
+{
+    float   *CHA_RESTRICT ch, *yj;
+    int      i, j, k, cs, gc, nc, ni, ns, nw;
+
+    assert(cx->ch != NULL);
+    gc = (cx->gcppk != NULL);
+    cs = cx->cs;
+    nc = cx->nc;
+    nw = cx->nw;
+    if (gc) {
+        FIRFB_SPEC(FIRFB_CASE)
+    }
+    ch = cx->ch;
+    ns = (n < nw) ? n : nw;
+    // loop over sub-chunk segments
+    for (j = 0; j < n; j += ns) {
+        ni = ((n - j) < ns) ? (n - j) : ns;
+        yj = y + j;
+        firfb_xform(cx, x + j, ni, cs, nw);
+        // loop over channels
+        for (k = 0; k < nc; k++) {
+            firfb_chan(cx, ch, ni, k, cs, nw);
+            if (gc) {
+                cha_agc_chan_cx(cx, ch, ch, ni, k);
+            }
+            if (k == 0) {
+                fcopy(yj, ch, ni);
+            } else {
+                for (i = 0; i < ni; i++) {
+                    yj[i] += ch[i];
+                }
+            }
+        }
     }
 }
 
+FUNC(void)
+cha_firfb_process(CHA_PTR cp, float *x, float *y, int n)
+{
+    CHA_CTX cx;
+
+    cha_context(cp, &cx);
+    cha_firfb_process_cx(&cx, x, y, n);
+}
+
+// replace the filterbank in the staging parameters (see cha_param.c)
+// by the nc FIR filters of nw taps in bb
+FUNC(int)
+cha_firfb_param(CHA_PTR cp, float *bb)
+{
+    float   *hh, *hk;
+    int      cs, j, k, nc, nk, ns, nt, nw;
+
+    hh = (float *) cp[_ffhhs];
+    if (hh == NULL) {
+        return (1);
+    }
+    cs = CHA_IVAR[_cs];
+    nw = CHA_IVAR[_nw];
+    nc = CHA_IVAR[_nc];
+    // transform each filter (or each cs-tap partition of it)
+    nk = (cs < nw) ? nw / cs : 1;
+    nt = (cs < nw) ? cs * 2 : nw * 2;
+    ns = nt + 2;
+    for (k = 0; k < nc; k++) {
+        for (j = 0; j < nk; j++) {
+            hk = hh + (k * nk + j) * ns;
+            fzero(hk, ns);
+            fcopy(hk, bb + k * nw + j * (nt / 2), nt / 2);
+            cha_fft_rc(hk, nt);
+        }
+    }
+
+    return (0);
+}
+
 // FIR-filterbank synthesis
 FUNC(void)
-cha_firfb_synthesize(CHA_PTR cp, float *x, float *y, int cs)
+cha_firfb_synthesize_cx(CHA_CTX *cx, float *x, float *y, int cs)
 {
     float    xsum;
     int      i, k, nc;
 
-    nc = CHA_IVAR[_nc];
+    nc = cx->nc;
     for (i = 0; i < cs; i++) {
         xsum = 0;
         for (k = 0; k < nc; k++) {
@@ -206,3 +818,174 @@ cha_firfb_synthesize(CHA_PTR cp, float *x, float *y, int cs)
         y[i] = xsum;
     }
 }
+
+FUNC(void)
+cha_firfb_synthesize(CHA_PTR cp, float *x, float *y, int cs)
+{
+    CHA_CTX cx;
+
+    cha_context(cp, &cx);
+    cha_firfb_synthesize_cx(&cx, x, y, cs);
+}
+
+/***********************************************************/
+
+// fixed-point FIR filterbank (cs >= nw), see cha_fix.h: each segment
+// is normalized & transformed once, each channel's spectrum is the
+// product with the channel's Q31 response and is normalized again
+// before the inverse transform, so the precision does not depend on
+// the signal level
+
+// shift block left by s (right for s < 0); the left shift is done
+// unsigned, since shifting a negative int left is undefined
+static __inline void
+shift_q(int *x, int n, int s)
+{
+    int      i;
+
+    if (s > 0) {
+        for (i = 0; i < n; i++) x[i] = (int) ((unsigned int) x[i] << s);
+    } else if (s < 0) {
+        s = (s < -31) ? 31 : -s;
+        for (i = 0; i < n; i++) x[i] >>= s;
+    }
+}
+
+// normalize block to 30 bits & return the shift
+static __inline int
+norm_q(int *x, int n)
+{
+    int      i, s;
+    unsigned int a, mx;
+
+    mx = 0;
+    for (i = 0; i < n; i++) {
+        a = (x[i] < 0) ? -x[i] : x[i];
+        mx |= a;
+    }
+    if (mx == 0) {
+        return (0);
+    }
+    s = cha_clz(mx) - 2;
+    shift_q(x, n, s);
+    return (s);
+}
+
+// convert block with exponent e to CHA_QS samples
+static __inline int
+to_qs(int v, int s)
+{
+    if (s >= 0) {
+        return (cha_sat32((cha_i64) v * ((cha_i64) 1 << ((s > 32) ? 32 : s))));
+    }
+    return (v >> ((s < -31) ? 31 : -s));
+}
+
+// fixed-point filterbank setup: Q31 channel responses (with an
+// exponent each) from the float ones, FFT plan & state; requires
+// cha_firfb_setup and cs >= nw
+FUNC(int)
+cha_firfb_setup_q(CHA_PTR cp)
+{
+    double   mx;
+    float   *hh, *hk;
+    int      i, k, e, cs, nc, ns, nt, nw, *hq, *eh;
+
+    cs = CHA_IVAR[_cs];
+    nw = CHA_IVAR[_nw];
+    nc = CHA_IVAR[_nc];
+    hh = (float *) cp[_ffhh];
+    if ((cs < nw) || (hh == NULL)) {
+        return (1);
+    }
+    nt = nw * 2;
+    ns = nt + 2;
+    if (cha_fftq_plan(cp, nt, _ffpq) == NULL) {
+        return (1);
+    }
+    hq = (int *) cha_allocate(cp, nc * ns, sizeof(int), _ffhq);
+    eh = (int *) cha_allocate(cp, nc, sizeof(int), _ffeq);
+    if ((hq == NULL) || (eh == NULL)) {
+        return (1);
+    }
+    for (k = 0; k < nc; k++) {
+        hk = hh + k * ns;
+        mx = 0;
+        for (i = 0; i < ns; i++) {
+            if (mx < fabs(hk[i])) mx = fabs(hk[i]);
+        }
+        frexp(mx, &e);
+        eh[k] = e - 30;             // |hq| <= 2^30
+        for (i = 0; i < ns; i++) {
+            hq[k * ns + i] = (int) floor(ldexp(hk[i], -eh[k]) + 0.5);
+        }
+    }
+    if (cha_allocate(cp, nc * nw, sizeof(int), _ffzq) == NULL) {
+        return (1);
+    }
+    if (cha_allocate(cp, ns * 2 + nw, sizeof(int), _ffwq) == NULL) {
+        return (1);
+    }
+
+    return (0);
+}
+
+// fixed-point analysis, channel compression & synthesis in one pass,
+// as cha_firfb_process, on CHA_QS samples (x and y may be the same)
+FUNC(void)
+cha_firfb_process_q(CHA_PTR cp, int *x, int *y, int cs)
+{
+    int      i, j, k, lg, nc, ni, ns, nt, nw, ex, ey, sh;
+    int     *hq, *eh, *xx, *yy, *ch, *hk, *zk, *yj;
+    void    *pl;
+
+    nc = CHA_IVAR[_nc];
+    nw = CHA_IVAR[_nw];
+    nt = nw * 2;
+    ns = nt + 2;
+    pl = cp[_ffpq];
+    hq = (int *) cp[_ffhq];
+    eh = (int *) cp[_ffeq];
+    xx = (int *) cp[_ffwq];
+    yy = xx + ns;
+    ch = yy + ns;
+    assert(pl != NULL);
+    for (lg = 0; (1 << lg) < nt; lg++);
+    // loop over segments
+    for (j = 0; j < cs; j += nw) {
+        ni = ((cs - j) < nw) ? (cs - j) : nw;
+        yj = y + j;
+        memcpy(xx, x + j, ni * sizeof(int));
+        memset(xx + ni, 0, (ns - ni) * sizeof(int));
+        ex = -CHA_QS - norm_q(xx, ni);
+        cha_fftq_rc(xx, nt, pl);
+        ex += lg;
+        // loop over channels
+        for (k = 0; k < nc; k++) {
+            hk = hq + k * ns;
+            zk = (int *) cp[_ffzq] + k * nw;
+            for (i = 0; i < ns; i += 2) {
+                yy[i] = (int) (((cha_i64) xx[i] * hk[i] - (cha_i64) xx[i + 1] * hk[i + 1]) >> 32);
+                yy[i + 1] = (int) (((cha_i64) xx[i] * hk[i + 1] + (cha_i64) xx[i + 1] * hk[i]) >> 32);
+            }
+            ey = ex + eh[k] + 32 - norm_q(yy, ns);
+            cha_fftq_cr(yy, nt, pl);
+            sh = ey + 1 + CHA_QS;
+            // overlap-add with tail of previous segment
+            for (i = 0; i < ni; i++) {
+                ch[i] = cha_sat32((cha_i64) to_qs(yy[i], sh) + zk[i]);
+            }
+            for (i = 0; i < nw; i++) {
+                zk[i] = to_qs(yy[ni + i], sh);
+            }
+            cha_agc_chan_q(cp, ch, ch, ni, k);
+            if (k == 0) {
+                memcpy(yj, ch, ni * sizeof(int));
+            } else {
+                for (i = 0; i < ni; i++) {
+                    yj[i] = cha_sat32((cha_i64) yj[i] + ch[i]);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,137 @@
+// limit_process.c - look-ahead output limiter
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "chapro.h"
+#include "cha_ff.h"
+
+// The output is delayed by nd samples, so that the limiter knows the
+// peak of the nl = nd + 1 samples from the one being output to the
+// newest input.  That window maximum is kept in a monotonic deque:
+// each new magnitude removes the smaller ones behind it, and the
+// front is dropped when it leaves the window, so every sample is
+// pushed & popped once (amortized O(1), not O(nl) per sample).  The
+// gain that brings the window peak down to the threshold is averaged
+// over the last nl samples, which ramps the gain down over the whole
+// look-ahead and still reaches the required gain at the peak.  The
+// release is smoothed with the output compressor's release constant.
+
+typedef struct {
+    int nl;             // window length (look-ahead delay + 1)
+    int jw;             // write position of delay line & gain ring
+    int qf;             // deque front position
+    int nq;             // deque length
+    unsigned int t;     // sample count (wraps)
+    float thr;          // limiting threshold (full scale = 1)
+    float beta;         // release coefficient
+    float gain;         // smoothed gain
+    double gsum;        // sum of the gain ring
+} LIM_STATE;
+
+/***********************************************************/
+
+// set up the limiter with a look-ahead of ms milliseconds and a
+// threshold of bolt dB SPL, e.g. the prescription's CHA_DVAR[_bolt]
+FUNC(int)
+cha_limit_setup(CHA_PTR cp, double ms, double bolt)
+{
+    float   *gr;
+    int      i, nl;
+    LIM_STATE *ls;
+
+    nl = (int) (ms * CHA_DVAR[_fs] / 1000 + 0.5) + 1;
+    ls = (LIM_STATE *) cha_allocate(cp, 1, sizeof(LIM_STATE), _lmst);
+    if (ls == NULL) {
+        return (1);
+    }
+    // delay line, gain ring & deque magnitudes
+    gr = (float *) cha_allocate(cp, nl * 3, sizeof(float), _lmbuf);
+    if (gr == NULL) {
+        return (1);
+    }
+    // deque sample counts
+    if (cha_allocate(cp, nl, sizeof(unsigned int), _lmqt) == NULL) {
+        return (1);
+    }
+    gr += nl;
+    for (i = 0; i < nl; i++) {
+        gr[i] = 1;
+    }
+    ls->nl = nl;
+    ls->thr = (float) pow(10, (bolt - CHA_DVAR[_mxdb]) / 20);
+    ls->beta = (float) CHA_DVAR[_beta];
+    ls->gain = 1;
+    ls->gsum = nl;
+
+    return (0);
+}
+
+// limit a chunk of output; passes x through when the limiter
+// is not set up (x and y may be the same array)
+FUNC(void)
+cha_limit_process(CHA_PTR cp, float *x, float *y, int cs)
+{
+    float   *dl, *gr, *qv, a, m, s, g, xd, thr, beta, rnl;
+    int      i, j, nl, jw, qf, nq;
+    unsigned int t, *qt;
+    double   gsum;
+    LIM_STATE *ls;
+
+    ls = (LIM_STATE *) cp[_lmst];
+    if (ls == NULL) {
+        if (x != y) fcopy(y, x, cs);
+        return;
+    }
+    nl = ls->nl;
+    dl = (float *) cp[_lmbuf];
+    gr = dl + nl;
+    qv = gr + nl;
+    qt = (unsigned int *) cp[_lmqt];
+    jw = ls->jw;
+    qf = ls->qf;
+    nq = ls->nq;
+    t = ls->t;
+    thr = ls->thr;
+    beta = ls->beta;
+    g = ls->gain;
+    gsum = ls->gsum;
+    rnl = 1.0f / nl;
+    for (i = 0; i < cs; i++) {
+        a = fabsf(x[i]);
+        // window maximum
+        while (nq && ((t - qt[qf]) >= (unsigned int) nl)) {
+            qf = (qf + 1 < nl) ? qf + 1 : 0;
+            nq--;
+        }
+        while (nq) {
+            j = qf + nq - 1;
+            j = (j < nl) ? j : j - nl;
+            if (qv[j] > a) break;
+            nq--;
+        }
+        j = qf + nq;
+        j = (j < nl) ? j : j - nl;
+        qv[j] = a;
+        qt[j] = t;
+        nq++;
+        t++;
+        // gain for the window peak, averaged over the window
+        m = (qv[qf] > thr) ? thr / qv[qf] : 1;
+        gsum += m - gr[jw];
+        gr[jw] = m;
+        s = (float) gsum * rnl;
+        g = (s < g) ? s : beta * g + (1 - beta) * s;
+        // delay line
+        dl[jw] = x[i];
+        jw = (jw + 1 < nl) ? jw + 1 : 0;
+        xd = dl[jw];
+        y[i] = xd * g;
+    }
+    ls->jw = jw;
+    ls->qf = qf;
+    ls->nq = nq;
+    ls->t = t;
+    ls->gain = g;
+    ls->gsum = gsum;
+}
@@ -6,7 +6,23 @@
 #include <assert.h>
 #include "chapro.h"
 #include "cha_ff.h"
-#include <arm_math.h>
+#include "cha_simd.h"
+
+#ifndef USE_ARM_MATH
+  #if defined(__arm__)
+    #define USE_ARM_MATH 1
+  #else
+    #define USE_ARM_MATH 0  //host builds use the math library
+  #endif
+#endif
+#if USE_ARM_MATH == 1
+  #include <arm_math.h>
+  #define fft_cos(x)    arm_cos_f32(x)
+  #define fft_sin(x)    arm_sin_f32(x)
+#else
+  #define fft_cos(x)    cosf(x)
+  #define fft_sin(x)    sinf(x)
+#endif
 
 /***********************************************************/
 // FFT functions adapted from G. D. Bergland, "Subroutines FAST and FSST," (1979).
@@ -95,6 +111,338 @@ reorder2(int m, float *x)
     }
 }
 
+// FFT plan: twiddle factors & re-order swaps precomputed for one size
+
+#define PL_HEAD     8           // plan header size (words)
+#define PL_N(p)     ((p)[0])    // transform size
+#define PL_M(p)     ((p)[1])    // log2 of transform size
+#define PL_NTW(p)   ((p)[2])    // number of twiddle groups
+#define PL_NR1(p)   ((p)[3])    // number of reorder1 swaps
+#define PL_NR2(p)   ((p)[4])    // number of reorder2 swaps
+#define PL_TW(p)    ((float *) (p) + PL_HEAD)
+#define PL_R1(p)    ((p) + PL_HEAD + PL_NTW(p) * 6)
+#define PL_R2(p)    (PL_R1(p) + PL_NR1(p) * 2)
+
+static int
+reorder1_swaps(int m, int *sw)
+{
+    int     j, k, kl, n, ns;
+
+    k = 4;
+    kl = 2;
+    n = 1 << m;
+    ns = 0;
+    for (j = 4; j <= n; j += 2) {
+        if (k > j) {
+            if (sw) {
+                sw[ns * 2] = j - 1;
+                sw[ns * 2 + 1] = k - 1;
+            }
+            ns++;
+        }
+        k -= 2;
+        if (k <= kl) {
+            k = 2 * j;
+            kl = j;
+        }
+    }
+    return (ns);
+}
+
+static int
+reorder2_swaps(int m, int *sw)
+{
+    int     ji, ij, n, ns;
+
+    n = 1 << m;
+    ns = 0;
+    for (ij = 0; ij <= (n - 2); ij += 2) {
+        ji = bitrev(ij >> 1, m) << 1;
+        if (ij < ji) {
+            if (sw) {
+                sw[ns * 2] = ij;
+                sw[ns * 2 + 1] = ji;
+            }
+            ns++;
+        }
+    }
+    return (ns);
+}
+
+static int
+twiddle_groups(int m, float *tw)
+{
+    double  arg, tpiovn;
+    int     i0, it, mi, m2, n4, ng, ni, nn;
+
+    m2 = m / 2;
+    nn = (m <= m2 * 2) ? 1 : 2;
+    ng = 0;
+    for (it = 0; it < m2; it++) {
+        nn = nn * 4;
+        n4 = nn / 4;
+        for (mi = 1; (1 << mi) < n4; mi++)
+            continue;
+        tpiovn = 2 * M_PI / nn;
+        ni = (n4 + 1) / 2;
+        for (i0 = 1; i0 < ni; i0++) {
+            if (tw) {
+                arg = tpiovn * bitrev(i0, mi);
+                tw[ng * 6 + 0] = (float) cos(arg);
+                tw[ng * 6 + 1] = (float) sin(arg);
+                tw[ng * 6 + 2] = (float) cos(2 * arg);
+                tw[ng * 6 + 3] = (float) sin(2 * arg);
+                tw[ng * 6 + 4] = (float) cos(3 * arg);
+                tw[ng * 6 + 5] = (float) sin(3 * arg);
+            }
+            ng++;
+        }
+    }
+    return (ng);
+}
+
+static __inline void
+swap1(int *sw, int ns, float *x)
+{
+    int     i, j, k;
+    float   t;
+
+    for (i = 0; i < ns; i++) {
+        j = sw[i * 2];
+        k = sw[i * 2 + 1];
+        t = x[j];
+        x[j] = x[k];
+        x[k] = t;
+    }
+}
+
+static __inline void
+swap2(int *sw, int ns, float *x)
+{
+    int     i, j, k;
+    float   t;
+
+    for (i = 0; i < ns; i++) {
+        j = sw[i * 2];
+        k = sw[i * 2 + 1];
+        t = x[j];
+        x[j] = x[k];
+        x[k] = t;
+        t = x[j + 1];
+        x[j + 1] = x[k + 1];
+        x[k + 1] = t;
+    }
+}
+
+/***********************************************************/
+
+// SIMD butterflies: each kernel processes the leading multiple of
+// CHA_SIMD elements of a butterfly group and returns the count done;
+// the scalar loops below finish the remainder.
+
+#ifdef CHA_SIMD
+
+static __inline int
+rcbf0_v(int n, float *x0, float *x1, float *x2, float *x3)
+{
+    cha_vf   t0, t1, v0, v1, v2, v3;
+    int      k;
+
+    for (k = 0; k + CHA_SIMD <= n; k += CHA_SIMD) {
+        v0 = vf_load(x0 + k);
+        v1 = vf_load(x1 + k);
+        v2 = vf_load(x2 + k);
+        v3 = vf_load(x3 + k);
+        t0 = vf_add(v0, v2);
+        t1 = vf_add(v1, v3);
+        vf_store(x2 + k, vf_sub(v0, v2));
+        vf_store(x3 + k, vf_sub(v1, v3));
+        vf_store(x0 + k, vf_add(t0, t1));
+        vf_store(x1 + k, vf_sub(t0, t1));
+    }
+    return (k);
+}
+
+static __inline int
+rcbf1_v(int n, float *x0, float *x1, float *x2, float *x3)
+{
+    cha_vf   pr, pi, r2, v0, v1, v2, v3;
+    int      k;
+
+    r2 = vf_dup((float) M_SQRT1_2);
+    for (k = 0; k + CHA_SIMD <= n; k += CHA_SIMD) {
+        v0 = vf_load(x0 + k);
+        v1 = vf_load(x1 + k);
+        v2 = vf_load(x2 + k);
+        v3 = vf_load(x3 + k);
+        pr = vf_mul(r2, vf_sub(v1, v3));
+        pi = vf_mul(r2, vf_add(v1, v3));
+        vf_store(x3 + k, vf_add(v2, pi));
+        vf_store(x1 + k, vf_sub(pi, v2));
+        vf_store(x2 + k, vf_sub(v0, pr));
+        vf_store(x0 + k, vf_add(v0, pr));
+    }
+    return (k);
+}
+
+static __inline int
+rcbf2_v(int n,
+    float *x0, float *x1, float *x2, float *x3,
+    float *x4, float *x5, float *x6, float *x7,
+    float c1, float s1, float c2, float s2, float c3, float s3)
+{
+    cha_vf   vc1, vs1, vc2, vs2, vc3, vs3, a, b, r1, r5;
+    cha_vf   t0, t1, t2, t3, t4, t5, t6, t7;
+    int      j;
+
+    vc1 = vf_dup(c1);
+    vs1 = vf_dup(s1);
+    vc2 = vf_dup(c2);
+    vs2 = vf_dup(s2);
+    vc3 = vf_dup(c3);
+    vs3 = vf_dup(s3);
+    for (j = 0; j + CHA_SIMD <= n; j += CHA_SIMD) {
+        a = vf_load(x1 + j);
+        b = vf_load(x5 + j);
+        r1 = vf_sub(vf_mul(a, vc1), vf_mul(b, vs1));
+        r5 = vf_add(vf_mul(a, vs1), vf_mul(b, vc1));
+        a = vf_load(x2 + j);
+        b = vf_load(x6 + j);
+        t2 = vf_sub(vf_mul(a, vc2), vf_mul(b, vs2));
+        t6 = vf_add(vf_mul(a, vs2), vf_mul(b, vc2));
+        a = vf_load(x3 + j);
+        b = vf_load(x7 + j);
+        t3 = vf_sub(vf_mul(a, vc3), vf_mul(b, vs3));
+        t7 = vf_add(vf_mul(a, vs3), vf_mul(b, vc3));
+        a = vf_load(x0 + j);
+        b = vf_load(x4 + j);
+        t0 = vf_add(a, t2);
+        t4 = vf_add(b, t6);
+        t2 = vf_sub(a, t2);
+        t6 = vf_sub(b, t6);
+        t1 = vf_add(r1, t3);
+        t5 = vf_add(r5, t7);
+        t3 = vf_sub(r1, t3);
+        t7 = vf_sub(r5, t7);
+        vf_store(x0 + j, vf_add(t0, t1));
+        vf_store(x7 + j, vf_add(t4, t5));
+        vf_store(x6 + j, vf_sub(t0, t1));
+        vf_store(x1 + j, vf_sub(t5, t4));
+        vf_store(x2 + j, vf_sub(t2, t7));
+        vf_store(x5 + j, vf_add(t6, t3));
+        vf_store(x4 + j, vf_add(t2, t7));
+        vf_store(x3 + j, vf_sub(t3, t6));
+    }
+    return (j);
+}
+
+static __inline int
+crbf0_v(int n, float *x0, float *x1, float *x2, float *x3)
+{
+    cha_vf   t0, t1, t2, t3, v0, v1, two;
+    int      k;
+
+    two = vf_dup(2);
+    for (k = 0; k + CHA_SIMD <= n; k += CHA_SIMD) {
+        v0 = vf_load(x0 + k);
+        v1 = vf_load(x1 + k);
+        t0 = vf_add(v0, v1);
+        t1 = vf_sub(v0, v1);
+        t2 = vf_mul(vf_load(x2 + k), two);
+        t3 = vf_mul(vf_load(x3 + k), two);
+        vf_store(x0 + k, vf_add(t0, t2));
+        vf_store(x2 + k, vf_sub(t0, t2));
+        vf_store(x1 + k, vf_add(t1, t3));
+        vf_store(x3 + k, vf_sub(t1, t3));
+    }
+    return (k);
+}
+
+static __inline int
+crbf1_v(int n, float *x0, float *x1, float *x2, float *x3)
+{
+    cha_vf   t2, t3, v0, v1, v2, v3, two, sq2;
+    int      k;
+
+    two = vf_dup(2);
+    sq2 = vf_dup((float) M_SQRT2);
+    for (k = 0; k + CHA_SIMD <= n; k += CHA_SIMD) {
+        v0 = vf_load(x0 + k);
+        v1 = vf_load(x1 + k);
+        v2 = vf_load(x2 + k);
+        v3 = vf_load(x3 + k);
+        t2 = vf_sub(v0, v2);
+        t3 = vf_add(v1, v3);
+        vf_store(x0 + k, vf_mul(vf_add(v0, v2), two));
+        vf_store(x2 + k, vf_mul(vf_sub(v3, v1), two));
+        vf_store(x1 + k, vf_mul(vf_add(t2, t3), sq2));
+        vf_store(x3 + k, vf_mul(vf_sub(t3, t2), sq2));
+    }
+    return (k);
+}
+
+static __inline int
+crbf2_v(int n,
+    float *x0, float *x1, float *x2, float *x3,
+    float *x4, float *x5, float *x6, float *x7,
+    float c1, float s1, float c2, float s2, float c3, float s3)
+{
+    cha_vf   vc1, vs1, vc2, vs2, vc3, vs3, a, b;
+    cha_vf   t0, t1, t2, t3, t4, t5, t6, t7;
+    int      j;
+
+    vc1 = vf_dup(c1);
+    vs1 = vf_dup(s1);
+    vc2 = vf_dup(c2);
+    vs2 = vf_dup(s2);
+    vc3 = vf_dup(c3);
+    vs3 = vf_dup(s3);
+    for (j = 0; j + CHA_SIMD <= n; j += CHA_SIMD) {
+        a = vf_load(x0 + j);
+        b = vf_load(x6 + j);
+        t0 = vf_add(a, b);
+        t2 = vf_sub(a, b);
+        a = vf_load(x7 + j);
+        b = vf_load(x1 + j);
+        t1 = vf_sub(a, b);
+        t3 = vf_add(a, b);
+        a = vf_load(x2 + j);
+        b = vf_load(x4 + j);
+        t4 = vf_add(a, b);
+        t7 = vf_sub(b, a);
+        a = vf_load(x5 + j);
+        b = vf_load(x3 + j);
+        t5 = vf_sub(a, b);
+        t6 = vf_add(a, b);
+        vf_store(x0 + j, vf_add(t0, t4));
+        vf_store(x4 + j, vf_add(t1, t5));
+        a = vf_add(t2, t6);
+        b = vf_add(t3, t7);
+        vf_store(x1 + j, vf_sub(vf_mul(a, vc1), vf_mul(b, vs1)));
+        vf_store(x5 + j, vf_add(vf_mul(a, vs1), vf_mul(b, vc1)));
+        a = vf_sub(t0, t4);
+        b = vf_sub(t1, t5);
+        vf_store(x2 + j, vf_sub(vf_mul(a, vc2), vf_mul(b, vs2)));
+        vf_store(x6 + j, vf_add(vf_mul(a, vs2), vf_mul(b, vc2)));
+        a = vf_sub(t2, t6);
+        b = vf_sub(t3, t7);
+        vf_store(x3 + j, vf_sub(vf_mul(a, vc3), vf_mul(b, vs3)));
+        vf_store(x7 + j, vf_add(vf_mul(a, vs3), vf_mul(b, vc3)));
+    }
+    return (j);
+}
+
+#else   // scalar reference only
+
+#define rcbf0_v(n,x0,x1,x2,x3)      0
+#define rcbf1_v(n,x0,x1,x2,x3)      0
+#define rcbf2_v(n,x0,x1,x2,x3,x4,x5,x6,x7,c1,s1,c2,s2,c3,s3) 0
+#define crbf0_v(n,x0,x1,x2,x3)      0
+#define crbf1_v(n,x0,x1,x2,x3)      0
+#define crbf2_v(n,x0,x1,x2,x3,x4,x5,x6,x7,c1,s1,c2,s2,c3,s3) 0
+
+#endif // CHA_SIMD
+
 /***********************************************************/
 
 // rcfft
@@ -102,7 +450,7 @@ reorder2(int m, float *x)
 static void
 rcrad4(int ii, int nn,
     float *x0, float *x1, float *x2, float *x3,
-    float *x4, float *x5, float *x6, float *x7)
+    float *x4, float *x5, float *x6, float *x7, float *tw)
 {
     double  arg, tpiovn;
     float   c1, c2, c3, s1, s2, s3, pr, pi, r1, r5;
@@ -119,7 +467,7 @@ rcrad4(int ii, int nn,
     ni = (n + 1) / 2;
     for (i0 = 0; i0 < ni; i0++) {
         if (i0 == 0) {
-            for (k = 0; k < ii; k++) {
+            for (k = rcbf0_v(ii, x0, x1, x2, x3); k < ii; k++) {
                 t0 = x0[k] + x2[k];
                 t1 = x1[k] + x3[k];
                 x2[k] = x0[k] - x2[k];
@@ -130,7 +478,8 @@ rcrad4(int ii, int nn,
             if (nn > 4) {
                 k0 = ii * 4;
                 kl = k0 + ii;
-                for (k = k0; k < kl; k++) {
+                k = k0 + rcbf1_v(ii, x0 + k0, x1 + k0, x2 + k0, x3 + k0);
+                for (; k < kl; k++) {
                     pr = (float) (M_SQRT1_2 * (x1[k] - x3[k]));
                     pi = (float) (M_SQRT1_2 * (x1[k] + x3[k]));
                     x3[k] = x2[k] + pi;
@@ -140,20 +489,32 @@ rcrad4(int ii, int nn,
                 }
             }
         } else {
-            arg = tpiovn * bitrev(i0, m);
-            //c1 = cosf(arg);
-            //s1 = sinf(arg);
-            c1 = arm_cos_f32(arg);
-            s1 = arm_sin_f32(arg);
-            c2 = c1 * c1 - s1 * s1;
-            s2 = c1 * s1 + c1 * s1;
-            c3 = c1 * c2 - s1 * s2;
-            s3 = c2 * s1 + s2 * c1;
+            if (tw) {
+                c1 = tw[0];
+                s1 = tw[1];
+                c2 = tw[2];
+                s2 = tw[3];
+                c3 = tw[4];
+                s3 = tw[5];
+                tw += 6;
+            } else {
+                arg = tpiovn * bitrev(i0, m);
+                //c1 = cosf(arg);
+                //s1 = sinf(arg);
+                c1 = fft_cos(arg);
+                s1 = fft_sin(arg);
+                c2 = c1 * c1 - s1 * s1;
+                s2 = c1 * s1 + c1 * s1;
+                c3 = c1 * c2 - s1 * s2;
+                s3 = c2 * s1 + s2 * c1;
+            }
             i4 = ii * 4;
             j0 = jr * i4;
             k0 = ji * i4;
             jlast = j0 + ii;
-            for (j = j0; j < jlast; j++) {
+            j = j0 + rcbf2_v(ii, x0 + j0, x1 + j0, x2 + j0, x3 + j0,
+                x4 + k0, x5 + k0, x6 + k0, x7 + k0, c1, s1, c2, s2, c3, s3);
+            for (; j < jlast; j++) {
                 k = k0 + j - j0;
                 r1 = x1[j] * c1 - x5[k] * s1;
                 r5 = x1[j] * s1 + x5[k] * c1;
@@ -191,12 +552,14 @@ rcrad4(int ii, int nn,
 //-----------------------------------------------------------
 
 static int
-rcfft2(float *x, int m)
+rcfft2(float *x, int m, int *pl)
 {
+    float  *tw;
     int     ii, nn, m2, it, n;
 
     n = 1 << m;;
     m2 = m / 2;
+    tw = pl ? PL_TW(pl) : NULL;
 
 // radix 2
 
@@ -215,14 +578,20 @@ rcfft2(float *x, int m)
             nn = nn * 4;
             ii = n / nn;
             rcrad4(ii, nn, x, x + ii, x + 2 * ii, x + 3 * ii,
-                x, x + ii, x + 2 * ii, x + 3 * ii);
+                x, x + ii, x + 2 * ii, x + 3 * ii, tw);
+            if (tw) tw += ((nn / 4 + 1) / 2 - 1) * 6;
         }
     }
 
 // re-order
 
-    reorder1(m, x);
-    reorder2(m, x);
+    if (pl) {
+        swap1(PL_R1(pl), PL_NR1(pl), x);
+        swap2(PL_R2(pl), PL_NR2(pl), x);
+    } else {
+        reorder1(m, x);
+        reorder2(m, x);
+    }
     for (it = 3; it < n; it += 2)
         x[it] = -x[it];
     x[n] = x[1];
@@ -239,7 +608,7 @@ rcfft2(float *x, int m)
 static void
 crrad4(int jj, int nn,
     float *x0, float *x1, float *x2, float *x3,
-    float *x4, float *x5, float *x6, float *x7)
+    float *x4, float *x5, float *x6, float *x7, float *tw)
 {
     double  arg, tpiovn;
     float   c1, c2, c3, s1, s2, s3;
@@ -256,7 +625,7 @@ crrad4(int jj, int nn,
     ni = (n + 1) / 2;
     for (ii = 0; ii < ni; ii++) {
         if (ii == 0) {
-            for (k = 0; k < jj; k++) {
+            for (k = crbf0_v(jj, x0, x1, x2, x3); k < jj; k++) {
                 t0 = x0[k] + x1[k];
                 t1 = x0[k] - x1[k];
                 t2 = x2[k] * 2;
@@ -269,7 +638,8 @@ crrad4(int jj, int nn,
             if (nn > 4) {
                 k0 = jj * 4;
                 kl = k0 + jj;
-                for (k = k0; k < kl; k++) {
+                k = k0 + crbf1_v(jj, x0 + k0, x1 + k0, x2 + k0, x3 + k0);
+                for (; k < kl; k++) {
                     t2 = x0[k] - x2[k];
                     t3 = x1[k] + x3[k];
                     x0[k] = (x0[k] + x2[k]) * 2;
@@ -279,20 +649,32 @@ crrad4(int jj, int nn,
                 }
             }
         } else {
-            arg = tpiovn * bitrev(ii, m);
-            //c1 = cosf(arg);
-            //s1 = -sinf(arg);
-            c1 = arm_cos_f32(arg);
-            s1 = -arm_sin_f32(arg);
-            c2 = c1 * c1 - s1 * s1;
-            s2 = c1 * s1 + c1 * s1;
-            c3 = c1 * c2 - s1 * s2;
-            s3 = c2 * s1 + s2 * c1;
+            if (tw) {
+                c1 = tw[0];
+                s1 = -tw[1];
+                c2 = tw[2];
+                s2 = -tw[3];
+                c3 = tw[4];
+                s3 = -tw[5];
+                tw += 6;
+            } else {
+                arg = tpiovn * bitrev(ii, m);
+                //c1 = cosf(arg);
+                //s1 = -sinf(arg);
+                c1 = fft_cos(arg);
+                s1 = -fft_sin(arg);
+                c2 = c1 * c1 - s1 * s1;
+                s2 = c1 * s1 + c1 * s1;
+                c3 = c1 * c2 - s1 * s2;
+                s3 = c2 * s1 + s2 * c1;
+            }
             j4 = jj * 4;
             j0 = jr * j4;
             k0 = ji * j4;
             jlast = j0 + jj;
-            for (j = j0; j < jlast; j++) {
+            j = j0 + crbf2_v(jj, x0 + j0, x1 + j0, x2 + j0, x3 + j0,
+                x4 + k0, x5 + k0, x6 + k0, x7 + k0, c1, s1, c2, s2, c3, s3);
+            for (; j < jlast; j++) {
                 k = k0 + j - j0;
                 t0 = x0[j] + x6[k];
                 t1 = x7[k] - x1[j];
@@ -324,20 +706,27 @@ crrad4(int jj, int nn,
 //-----------------------------------------------------------
 
 static int
-crfft2(float *x, int m)
+crfft2(float *x, int m, int *pl)
 {
+    float  *tw;
     int     n, i, it, nn, jj, m2;
 
     n = 1 << m;
     x[1] = x[n];
     m2 = m / 2;
+    tw = pl ? PL_TW(pl) + PL_NTW(pl) * 6 : NULL;
 
 // re-order
 
     for (i = 3; i < n; i += 2)
         x[i] = -x[i];
-    reorder2(m, x);
-    reorder1(m, x);
+    if (pl) {
+        swap2(PL_R2(pl), PL_NR2(pl), x);
+        swap1(PL_R1(pl), PL_NR1(pl), x);
+    } else {
+        reorder2(m, x);
+        reorder1(m, x);
+    }
 
 // radix 4
 
@@ -346,8 +735,9 @@ crfft2(float *x, int m)
         for (it = 0; it < m2; it++) {
             nn = nn / 4;
             jj = n / nn;
+            if (tw) tw -= ((nn / 4 + 1) / 2 - 1) * 6;
             crrad4(jj, nn, x, x + jj, x + 2 * jj, x + 3 * jj,
-                x, x + jj, x + 2 * jj, x + 3 * jj);
+                x, x + jj, x + 2 * jj, x + 3 * jj, tw);
         }
     }
 
@@ -373,7 +763,7 @@ cha_fft_rc(float *x, int n)
     // assume n is a power of two 
     m = ilog2(n);
     if (m <= 0) return (1);
-    err = rcfft2(x, m);
+    err = rcfft2(x, m, NULL);
 
     return (err);
 }
@@ -388,7 +778,7 @@ cha_fft_cr(float *x, int n)
     // assume n is a power of two 
     m = ilog2(n);
     if (m <= 0) return (1);
-    err = crfft2(x, m);
+    err = crfft2(x, m, NULL);
 
 // scale inverse by 1/n
 
@@ -398,3 +788,71 @@ cha_fft_cr(float *x, int n)
 
     return (err);
 }
+
+/***********************************************************/
+
+// create plan for size-n transforms & store at pointer index idx,
+// unless a plan for that size is already there
+
+FUNC(void *)
+cha_fft_plan(CHA_PTR cp, int n, int idx)
+{
+    int m, ntw, nr1, nr2, nw, *pl;
+
+    // assume n is a power of two 
+    m = ilog2(n);
+    if (m <= 0) return (NULL);
+    ntw = twiddle_groups(m, NULL);
+    nr1 = reorder1_swaps(m, NULL);
+    nr2 = reorder2_swaps(m, NULL);
+    nw = PL_HEAD + ntw * 6 + (nr1 + nr2) * 2;
+    pl = (int *) cp[idx];
+    if (pl && (((int *) cp[_size])[idx] == (int) (nw * sizeof(int)))
+        && (PL_N(pl) == n)) {
+        return (pl);
+    }
+    pl = (int *) cha_allocate(cp, nw, sizeof(int), idx);
+    if (pl == NULL) return (NULL);
+    PL_N(pl) = n;
+    PL_M(pl) = m;
+    PL_NTW(pl) = ntw;
+    PL_NR1(pl) = nr1;
+    PL_NR2(pl) = nr2;
+    twiddle_groups(m, PL_TW(pl));
+    reorder1_swaps(m, PL_R1(pl));
+    reorder2_swaps(m, PL_R2(pl));
+
+    return (pl);
+}
+
+// real-to-complex FFT using plan
+
+FUNC(int)
+cha_fft_rc_pl(float *x, int n, void *plan)
+{
+    int *pl = (int *) plan;
+
+    if ((pl == NULL) || (PL_N(pl) != n)) return (cha_fft_rc(x, n));
+    return (rcfft2(x, PL_M(pl), pl));
+}
+
+// complex-to-real inverse FFT using plan
+
+FUNC(int)
+cha_fft_cr_pl(float *x, int n, void *plan)
+{
+    float sc;
+    int i, err, *pl = (int *) plan;
+
+    if ((pl == NULL) || (PL_N(pl) != n)) return (cha_fft_cr(x, n));
+    err = crfft2(x, PL_M(pl), pl);
+
+// scale inverse by 1/n
+
+    sc = 1.0f / n;
+    for (i = 0; i < n; i++) {
+        x[i] *= sc;
+    }
+
+    return (err);
+}
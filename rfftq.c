@@ -0,0 +1,196 @@
+// rfftq.c - fixed-point real FFT (Q31)
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "chapro.h"
+#include "cha_fix.h"
+
+// Radix-2 complex FFT of n/2 points plus a split step for real data.
+// Every butterfly stage halves its outputs, so nothing can overflow
+// whatever the data: the forward transform returns X/n and the
+// inverse returns x/2, both relative to the scale of the input.
+// Callers use block floating point (normalize the block first and
+// keep its exponent) to hold the precision.
+
+// plan layout (ints): header, then Q31 twiddles of the complex FFT,
+// split twiddles & bit-reversed indices
+#define PQ_HEAD     3
+#define PQ_N(p)     (p[0])          // real transform size
+#define PQ_NH(p)    (p[1])          // complex transform size (n/2)
+#define PQ_M(p)     (p[2])          // log2(n/2)
+#define PQ_TW(p)    (p + PQ_HEAD)                   // n/4 complex
+#define PQ_SW(p)    (PQ_TW(p) + PQ_NH(p))           // n/4+1 complex
+#define PQ_BR(p)    (PQ_SW(p) + PQ_NH(p) + 2)       // n/2
+
+/***********************************************************/
+
+// complex FFT of nh points, outputs scaled by 1/nh
+static void
+cfftq(int *z, int nh, int *tw, int *br)
+{
+    int      h, i, j, ts, t0, t1, ar, ai, tr, ti, wr, wi, *a, *b;
+
+    for (i = 0; i < nh; i++) {
+        j = br[i];
+        if (j > i) {
+            t0 = z[2 * i];
+            t1 = z[2 * i + 1];
+            z[2 * i] = z[2 * j];
+            z[2 * i + 1] = z[2 * j + 1];
+            z[2 * j] = t0;
+            z[2 * j + 1] = t1;
+        }
+    }
+    for (h = 1; h < nh; h *= 2) {
+        ts = nh / (h * 2);
+        for (j = 0; j < h; j++) {
+            wr = tw[2 * j * ts];
+            wi = tw[2 * j * ts + 1];
+            for (i = j; i < nh; i += h * 2) {
+                a = z + 2 * i;
+                b = z + 2 * (i + h);
+                tr = (int) (((cha_i64) b[0] * wr - (cha_i64) b[1] * wi) >> 32);
+                ti = (int) (((cha_i64) b[0] * wi + (cha_i64) b[1] * wr) >> 32);
+                ar = a[0] >> 1;
+                ai = a[1] >> 1;
+                a[0] = ar + tr;
+                a[1] = ai + ti;
+                b[0] = ar - tr;
+                b[1] = ai - ti;
+            }
+        }
+    }
+}
+
+static __inline void
+conjq(int *z, int nh)
+{
+    int      i;
+
+    for (i = 0; i < nh; i++) {
+        z[2 * i + 1] = -z[2 * i + 1];
+    }
+}
+
+/***********************************************************/
+
+// create plan for size-n fixed-point transforms & store at pointer
+// index idx, unless a plan for that size is already there
+FUNC(void *)
+cha_fftq_plan(CHA_PTR cp, int n, int idx)
+{
+    double   a;
+    int      i, j, k, m, nh, nw, *pl;
+
+    nh = n / 2;
+    for (m = 0; (1 << m) < nh; m++);
+    if ((m < 1) || ((1 << m) != nh)) return (NULL);
+    nw = PQ_HEAD + nh + nh + 2 + nh;
+    pl = (int *) cp[idx];
+    if (pl && (((int *) cp[_size])[idx] == (int) (nw * sizeof(int)))
+        && (PQ_N(pl) == n)) {
+        return (pl);
+    }
+    pl = (int *) cha_allocate(cp, nw, sizeof(int), idx);
+    if (pl == NULL) return (NULL);
+    PQ_N(pl) = n;
+    PQ_NH(pl) = nh;
+    PQ_M(pl) = m;
+    for (k = 0; k < nh / 2; k++) {
+        a = 2 * M_PI * k / nh;
+        PQ_TW(pl)[2 * k] = cha_q31(cos(a));
+        PQ_TW(pl)[2 * k + 1] = cha_q31(-sin(a));
+    }
+    for (k = 0; k <= nh / 2; k++) {
+        a = 2 * M_PI * k / n;
+        PQ_SW(pl)[2 * k] = cha_q31(cos(a));
+        PQ_SW(pl)[2 * k + 1] = cha_q31(-sin(a));
+    }
+    for (i = 0; i < nh; i++) {
+        for (j = k = 0; k < m; k++) {
+            j |= ((i >> k) & 1) << (m - 1 - k);
+        }
+        PQ_BR(pl)[i] = j;
+    }
+
+    return (pl);
+}
+
+// real-to-complex FFT of n points in place (x holds n+2 ints);
+// returns bins 0 to n/2 as re/im pairs, scaled by 1/n
+FUNC(void)
+cha_fftq_rc(int *x, int n, void *plan)
+{
+    int      k, nh, er, ei, dr, di, or_, oi, tr, ti, *pl, *sw, *za, *zb;
+
+    pl = (int *) plan;
+    nh = PQ_NH(pl);
+    sw = PQ_SW(pl);
+    cfftq(x, nh, PQ_TW(pl), PQ_BR(pl));
+    // split: X[k] = (Xe + W^k Xo) / 2, X[nh-k] = conj(Xe - W^k Xo) / 2
+    er = x[0] >> 1;
+    ei = x[1] >> 1;
+    x[0] = er + ei;
+    x[1] = 0;
+    x[n] = er - ei;
+    x[n + 1] = 0;
+    for (k = 1; k <= nh / 2; k++) {
+        za = x + 2 * k;
+        zb = x + 2 * (nh - k);
+        er = (za[0] >> 1) + (zb[0] >> 1);      // (Z[k] + conj(Z[nh-k])) / 2
+        ei = (za[1] >> 1) - (zb[1] >> 1);
+        dr = (za[0] >> 1) - (zb[0] >> 1);      // (Z[k] - conj(Z[nh-k])) / 2
+        di = (za[1] >> 1) + (zb[1] >> 1);
+        or_ = di;                               // Xo = -i * d
+        oi = -dr;
+        tr = (int) (((cha_i64) or_ * sw[2 * k] - (cha_i64) oi * sw[2 * k + 1]) >> 32);
+        ti = (int) (((cha_i64) or_ * sw[2 * k + 1] + (cha_i64) oi * sw[2 * k]) >> 32);
+        er >>= 1;
+        ei >>= 1;
+        za[0] = er + tr;
+        za[1] = ei + ti;
+        zb[0] = er - tr;
+        zb[1] = ti - ei;
+    }
+}
+
+// complex-to-real inverse FFT of n points in place (x holds bins 0
+// to n/2 as re/im pairs); returns n samples scaled by 1/2
+FUNC(void)
+cha_fftq_cr(int *x, int n, void *plan)
+{
+    int      k, nh, ar, ai, br, bi, er, ei, dr, di, or_, oi, *pl, *sw, *za, *zb;
+
+    pl = (int *) plan;
+    nh = PQ_NH(pl);
+    sw = PQ_SW(pl);
+    // merge: Z[k] = (Xe + i Xo) / 2, with Xe = (X[k] + conj(X[nh-k])) / 2
+    // and Xo = (X[k] - conj(X[nh-k])) conj(W^k) / 2
+    ar = x[0] >> 1;
+    br = x[n] >> 1;
+    x[0] = (ar + br) >> 1;
+    x[1] = (ar - br) >> 1;
+    for (k = 1; k <= nh / 2; k++) {
+        za = x + 2 * k;
+        zb = x + 2 * (nh - k);
+        ar = za[0] >> 1;
+        ai = za[1] >> 1;
+        br = zb[0] >> 1;
+        bi = -(zb[1] >> 1);
+        er = ar + br;
+        ei = ai + bi;
+        dr = ar - br;
+        di = ai - bi;
+        or_ = (int) (((cha_i64) dr * sw[2 * k] + (cha_i64) di * sw[2 * k + 1]) >> 31);
+        oi = (int) (((cha_i64) di * sw[2 * k] - (cha_i64) dr * sw[2 * k + 1]) >> 31);
+        za[0] = (er >> 1) - (oi >> 1);
+        za[1] = (ei >> 1) + (or_ >> 1);
+        zb[0] = (er >> 1) + (oi >> 1);
+        zb[1] = (or_ >> 1) - (ei >> 1);
+    }
+    // inverse complex FFT by conjugation
+    conjq(x, nh);
+    cfftq(x, nh, PQ_TW(pl), PQ_BR(pl));
+    conjq(x, nh);
+}